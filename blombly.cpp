@@ -49,7 +49,9 @@ BError* NO_TRY_INTERCEPT = new BError("\033[0m(\x1B[31m ERROR \033[0m) No error
 extern void clearAllowedLocations();
 extern void initialize_dispatch_table();
 extern bool vsync;
+extern bool reportFusions;
 extern double wallclock_start;
+#define BLOMBLY_VERSION "1.19.0"
 
 #ifdef _WIN32
 #include <windows.h>
@@ -68,25 +70,40 @@ std::string get_executable_directory_simpler(const std::string& argv0) {
     return ".";
 }
 
-std::string get_executable_directory(const std::string& argv0) {
+std::string get_executable_file(const std::string& argv0) {
     char buffer[4096];
-
 #ifdef _WIN32
     DWORD len = GetModuleFileNameA(NULL, buffer, sizeof(buffer));
-    if (len <= 0 || len >= sizeof(buffer)) get_executable_directory_simpler(argv0);
-    std::string path(buffer);
-    size_t pos = path.find_last_of('\\');
+    if (len <= 0 || len >= sizeof(buffer)) return argv0;
 #else
     ssize_t len = readlink("/proc/self/exe", buffer, sizeof(buffer) - 1);
-    if (len == -1) get_executable_directory_simpler(argv0);
+    if (len == -1) return argv0;
+#endif
     buffer[len] = '\0';
-    std::string path(buffer);
+    return std::string(buffer);
+}
+
+std::string get_executable_directory(const std::string& argv0) {
+    std::string path = get_executable_file(argv0);
+#ifdef _WIN32
+    size_t pos = path.find_last_of('\\');
+#else
     size_t pos = path.find_last_of('/');
 #endif
     if (pos != std::string::npos) return path.substr(0, pos);
     return get_executable_directory_simpler(argv0);;
 }
 
+// Compiled programs are reused only by the exact interpreter build that compiled them, because changes to the parser,
+// macros, or optimizer alter compilation outcomes without changing the version. Unreadable executables never reuse programs.
+std::string get_build_identity(const std::string& executable) {
+    std::ifstream input(executable, std::ios::in | std::ios::binary);
+    if (!input) return std::to_string(std::chrono::system_clock::now().time_since_epoch().count());
+    std::string contents((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    CompiledSources::Entry entry = CompiledSources::hash(executable, contents);
+    return std::to_string(entry.low) + "-" + std::to_string(entry.high);
+}
+
 int main(int argc, char* argv[]) {
     initialize_dispatch_table();
     OUT_OF_RANGE->consume();
@@ -96,6 +113,7 @@ int main(int argc, char* argv[]) {
     NO_TRY_INTERCEPT->consume();
     NO_TRY_INTERCEPT->addOwner();
     
+    std::string executable = get_executable_file(argv[0]);
     blombly_executable_path = get_executable_directory(argv[0]);
     Terminal::enableVirtualTerminalProcessing();
     initializeOperationMapping();  
@@ -106,15 +124,16 @@ int main(int argc, char* argv[]) {
     int default_threads = threads;
     bool minimify = true;
     bool compress = true;
+    bool rebuild = false;
 
     if(threads == 0) threads = 4;
     std::vector<std::string> instructions;
     for(int i = 1; i < argc; ++i) {
         std::string arg = argv[i];
         if((arg == "--threads" || arg == "-t") && i + 1 < argc) threads = std::stoi(argv[++i]);
-        if((arg == "--depth" || arg == "-d") && i + 1 < argc) ExecutionInstance::maxDepth = std::stoi(argv[++i]);
+        else if((arg == "--depth" || arg == "-d") && i + 1 < argc) ExecutionInstance::maxDepth = std::stoi(argv[++i]);
         else if(arg == "--version" || arg == "-v") {
-            std::cout << "Version: blombly 1.19.0\n";
+            std::cout << "Version: blombly " << BLOMBLY_VERSION << "\n";
             return 0;
         } 
         else if(arg == "--help" || arg == "-h") {
@@ -125,18 +144,23 @@ int main(int argc, char* argv[]) {
             std::cout << "--strip           Strips away debugging symbols\n";
             std::cout << "--version         Prints the current blombly version\n";
             std::cout << "--text            Forces the produced bbvm files to look like text\n";
+            std::cout << "--rebuild         Compiles .bb files even if their sources have not changed\n";
             std::cout << "--depth <num>     Maximum stack depth\n";
+            std::cout << "--fusions         Reports the superinstructions created while loading\n";
             return 0;
         } 
         else if(arg == "--library" || arg == "-l") minimify = false;
         else if(arg == "--strip" || arg == "-s") debug_info = false;
         else if(arg == "--text") compress = false;
+        else if(arg == "--rebuild") rebuild = true;
         else if(arg == "--vsync") vsync = true;
+        else if(arg == "--fusions") reportFusions = true;
         else if(arg == "--norun") threads = 0;
         else instructions.push_back(arg);
     }
 
     if(instructions.empty()) instructions.push_back("main.bb");
+    compiledSources.options = std::string(BLOMBLY_VERSION)+" "+std::to_string(getOperationTableHash())+" "+get_build_identity(executable)+(minimify?" minimify":"")+(debug_info?" debug":"");
 
     int ret = 0;
     for(std::string fileName : instructions) {
@@ -158,8 +182,10 @@ int main(int argc, char* argv[]) {
                         || (fileName.size()>=5 && fileName.substr(fileName.size() - 5) == ".bbvm"),
                         "Blombly can only compile and run .bb or .bbvm files, or code enclosed in single quotes '...', but an invalid option was provided: "+fileName)
             if(fileName.size()>=3 && fileName.substr(fileName.size() - 3) == ".bb") {
-                compile(fileName, fileName + "vm");
-                optimize(fileName + "vm", fileName + "vm", minimify, compress);
+                if(rebuild || !compress || !reuse_up_to_date_bbvm(fileName, fileName + "vm")) {
+                    compile(fileName, fileName + "vm");
+                    optimize(fileName + "vm", fileName + "vm", minimify, compress);
+                }
                 fileName = fileName + "vm";
             }
         }
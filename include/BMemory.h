@@ -25,6 +25,7 @@
 #include <deque>
 #include <iostream>
 #include <atomic>
+#include <shared_mutex>
 #include "data/Data.h"
 #include "tsl/hopscotch_map.h"
 #include "tsl/hopscotch_set.h"
@@ -43,8 +44,16 @@ class Command;
 class VariableManager {
 private:
     tsl::hopscotch_map<std::string, int> registeredSymbols;
-    tsl::hopscotch_map<int, std::string> registeredIds;
-    tsl::hopscotch_set<int> retainInStruct;
+    std::vector<std::string> registeredIds;
+    std::vector<char> retainInStruct;
+    inline int add(const std::string& symbol, bool retain) {
+        auto [it, inserted] = registeredSymbols.try_emplace(symbol, static_cast<int>(registeredIds.size()));
+        if(inserted) {
+            registeredIds.push_back(symbol);
+            retainInStruct.push_back(retain);
+        }
+        return it->second;
+    }
 public:
     static constexpr int thisId = 0;
     static constexpr int argsId = 1;
@@ -93,6 +102,22 @@ public:
 
     static constexpr int maximumReservedId = 42; // needs to be exactly equal to the last value
 
+    // variables set by builtins are resolved once here instead of every time they are set
+    static constexpr int serverUri = 43;
+    static constexpr int serverQuery = 44;
+    static constexpr int serverMethod = 45;
+    static constexpr int serverHttp = 46;
+    static constexpr int serverIp = 47;
+    static constexpr int serverSsl = 48;
+    static constexpr int serverContent = 49;
+    static constexpr int ioKey = 50;
+    static constexpr int ioType = 51;
+    static constexpr int ioX = 52;
+    static constexpr int ioY = 53;
+    static constexpr int ioUsername = 54;
+    static constexpr int ioPassword = 55;
+    static constexpr int ioTimeout = 56;
+
 
     VariableManager() {
         getId("this");
@@ -138,22 +163,89 @@ public:
         getId("_bbconsole");
         getId("_bbanylist");
         getId("_bbmain");
+        getId("server::uri");
+        getId("server::query");
+        getId("server::method");
+        getId("server::http");
+        getId("server::ip");
+        getId("server::ssl");
+        getId("server::content");
+        getId("io::key");
+        getId("io::type");
+        getId("io::x");
+        getId("io::y");
+        getId("io::username");
+        getId("io::password");
+        getId("io::timeout");
     }
     const int size() {return registeredSymbols.size();}
+    static bool defaultRetain(const std::string& symbol) {
+        if(symbol.size()>8 && symbol.compare(0, 8, "_bbmacro")==0) return true;
+        return symbol.size()<3 || symbol.compare(0, 3, "_bb")!=0;
+    }
     int getId(const std::string& symbol) {
-        if(registeredSymbols.find(symbol) == registeredSymbols.end()) {
-            int id = registeredSymbols.size();
-            registeredSymbols[symbol] = id;
-            registeredIds[id] = symbol;
-            if(id==0) {} // thisid should never be retained
-            else if(symbol.size()>8 && symbol.substr(0, 8)=="_bbmacro") retainInStruct.insert(id);
-            else if(symbol.size()<3 || symbol.substr(0, 3)!="_bb") retainInStruct.insert(id);
+        auto it = registeredSymbols.find(symbol);
+        if(it!=registeredSymbols.end()) return it->second;
+        return add(symbol, registeredIds.size() && defaultRetain(symbol)); // thisid should never be retained
+    }
+    /**
+     * Registers a whole symbol table with precomputed retain flags (e.g., from a binary .bbvm file) and
+     * returns the id of each symbol. Symbols that are already registered keep their id and flag.
+     */
+    std::vector<int> registerSymbols(const std::vector<std::string>& symbols, const std::vector<char>& retain) {
+        std::vector<int> ids(symbols.size());
+        registeredSymbols.reserve(registeredSymbols.size()+symbols.size());
+        registeredIds.reserve(registeredIds.size()+symbols.size());
+        retainInStruct.reserve(retainInStruct.size()+symbols.size());
+        for(size_t i=0;i<symbols.size();++i) ids[i] = add(symbols[i], retain[i]);
+        return ids;
+    }
+    const std::string& getSymbol(int id) const {
+        static const std::string missing;
+        if(id<0 || static_cast<size_t>(id)>=registeredIds.size()) return missing;
+        return registeredIds[id];
+    }
+    const bool getIdRetain(int symbol) const {return static_cast<size_t>(symbol)<retainInStruct.size() && retainInStruct[symbol];}
+    void setIdRetain(int symbol) {retainInStruct[symbol] = true;}
+};
+
+
+/**
+ * Dense slot assignment for the symbols set by a code block, excluding the bodies of blocks nested in it.
+ * It is computed once when the program is loaded and shared by all frames running that code, so that
+ * symbol lookups become an array access instead of a hash probe. Symbols without a slot (e.g., those
+ * only read from enclosing scopes) fall back to the per-frame map and parent lookups.
+ */
+class FrameLayout {
+private:
+    // open-addressing table from symbol ids to slots with linear probing, sized to stay at most half full
+    std::vector<std::pair<int, int>> table;
+    unsigned int mask;
+public:
+    std::vector<int> symbols;
+    explicit FrameLayout(const std::vector<int>& assignedSymbols);
+    inline int slot(int item) const {
+        if(table.empty()) return -1;
+        unsigned int pos = (static_cast<unsigned int>(item)*2654435761u) & mask;
+        while(true) {
+            const auto& entry = table[pos];
+            if(entry.first==item) return entry.second;
+            if(entry.first==-1) return -1;
+            pos = (pos+1) & mask;
         }
-        return registeredSymbols[symbol];
     }
-    const std::string getSymbol(int id) {return registeredIds[id];}
-    const bool getIdRetain(int symbol) const {return retainInStruct.find(symbol) != retainInStruct.end();}
-    void setIdRetain(int symbol) {retainInStruct.insert(symbol);}
+    inline unsigned int size() const {return symbols.size();}
+};
+
+/**
+ * Owns the frame layouts of a program's code blocks. It lives next to the program so that layouts are
+ * released together with it, and a deque keeps the addresses held by code blocks stable as it grows.
+ */
+class FrameLayoutTable {
+private:
+    std::deque<FrameLayout> layouts;
+public:
+    inline const FrameLayout* add(const std::vector<int>& assignedSymbols) {return &layouts.emplace_back(assignedSymbols);}
 };
 
 
@@ -161,16 +253,53 @@ class BMemory {
 private:
     DataPtr* cache;
     unsigned int cache_size;
-    tsl::hopscotch_map<int, DataPtr> data;
+    tsl::hopscotch_map<int, DataPtr, std::hash<int>, std::equal_to<int>, PoolAllocator<std::pair<int, DataPtr>>> data;
     //std::vector<DataPtr> contents;
     void unsafeSet(int item, const DataPtr& value);
     std::vector<Code*> finally;
     int first_item;
     bool hasAtLeastOneFinal;
     void resolveFuture(DataPtr& ret);
-    const DataPtr& get(int item, bool allowMutable);
+    DataPtr get(int item, bool allowMutable);
+    std::atomic<int> sharedReaders; // calls running in other threads that may read this memory
+    std::shared_mutex sharedLock;
+    DataPtr& findShared(int item);
+    DataPtr* findExisting(int item) {
+        if(item>variableManager.maximumReservedId) {
+            if(layout) {
+                int slot = layout->slot(item);
+                if(slot>=0) return &cache[slot];
+            }
+            else if(first_item!=INT_MAX) {
+                int tentativeidx = item-first_item;
+                if(static_cast<unsigned int>(tentativeidx)<cache_size) return &cache[tentativeidx];
+            }
+        }
+        if(data.empty()) return nullptr;
+        auto it = data.find(item);
+        if(it==data.end()) return nullptr;
+        return &it.value();
+    }
+    DataPtr getShared(int item, bool allowMutable, bool orNull);
+    inline bool isShared() const {return sharedReaders.load(std::memory_order_acquire);}
+    // the owning thread writes slots of shared memories exclusively, because workers may be reading them
+    inline void store(DataPtr& slot, const DataPtr& value) {
+        if(isShared()) [[unlikely]] {
+            std::unique_lock<std::shared_mutex> lock(sharedLock);
+            slot = value;
+        }
+        else slot = value;
+    }
+    const FrameLayout* layout;
+    inline int symbolAt(unsigned int idx) const {return layout?layout->symbols[idx]:idx+first_item;}
     DataPtr& find(int item) {
+        if(isShared()) [[unlikely]] return findShared(item);
         if(item<=variableManager.maximumReservedId) return data[item];
+        if(layout) {
+            int slot = layout->slot(item);
+            if(slot<0) return data[item];
+            return cache[slot];
+        }
         if(first_item==INT_MAX) [[unlikely]] first_item = item;
         // have there be a difference everywhere to save one instruction
         int tentativeidx = item-first_item;
@@ -193,19 +322,26 @@ public:
     }
     unsigned int getDepth() const {return depth;}
     void release();
+    void markShared();
+    void unmarkShared();
+    void shareValues();
     bool allowMutables;
 
-    explicit BMemory(unsigned int depth, BMemory* par, int expectedAssignments);
+    explicit BMemory(unsigned int depth, BMemory* par, int expectedAssignments, const FrameLayout* layout=nullptr);
     ~BMemory();
 
-    const DataPtr& get(int item) {
-        DataPtr& ret = find(item);
-        if(ret.islitorexists()) return ret;
+    DataPtr get(int item) {
+        if(isShared()) [[unlikely]] return getShared(item, true, false);
+        DataPtr* ret = findExisting(item);
+        if(ret) {
+            if(ret->existsAndTypeEquals(FUTURE)) [[unlikely]] return get(item, true);
+            if(ret->islitorexists()) return *ret;
+        }
         if(parent) return parent->get(item, allowMutables);
         bberror("Missing value: " + variableManager.getSymbol(item));
     }
     const DataPtr& getShallow(int item);
-    const DataPtr& getOrNull(int item, bool allowMutable);
+    DataPtr getOrNull(int item, bool allowMutable);
     const DataPtr& getOrNullShallow(int item);
     void directTransfer(Struct* to);
     void directTransfer(int to, int from);
@@ -216,12 +352,10 @@ public:
     void unsafeSetLiteral(int item, const DataPtr& value) {
         auto& prev = find(item);
         if(prev.isA()) bberror("Cannot overwrite final value: " + variableManager.getSymbol(item));
-        if(prev.exists()) {
-            Data* prevData = prev.get();
-            if(prevData->getType()==ERRORTYPE && !static_cast<BError*>(prevData)->isConsumed()) bberror("Trying to overwrite an unhandled error:\n"+prevData->toString(this));
-            prevData->removeFromOwner();
-        }
-        prev = value;
+        Data* prevData = prev.exists()?prev.get():nullptr;
+        if(prevData && prevData->getType()==ERRORTYPE && !static_cast<BError*>(prevData)->isConsumed()) bberror("Trying to overwrite an unhandled error:\n"+prevData->toString(this));
+        store(prev, value);
+        if(prevData) prevData->removeFromOwner();
         //prev.setAFalse(); // this is not needed because this function is called only for newlly constructed literals. that said, it somehow speeds up the code
     }
 
@@ -50,7 +50,13 @@ enum OperationType {
     CALL, WHILE, IF, NEW, BB_PRINT, INLINE, GET, SET, SETFINAL, DEFAULT,
     TIME, TOITER, TRY, CATCH, FAIL, EXISTS, READ, CREATESERVER, AS, TORANGE, 
     DEFER, CLEAR, MOVE, ISCACHED, TOSQLITE, TOGRAPHICS, RANDOM,
-    RANDVECTOR, ZEROVECTOR, ALLOCVECTOR, LISTELEMENT, LISTGATHER
+    RANDVECTOR, ZEROVECTOR, ALLOCVECTOR, LISTELEMENT, LISTGATHER, STATS,
+    // superinstructions that are only created when loading programs
+    BUILTIN_ADD, BUILTIN_SUB, BUILTIN_MUL, BUILTIN_LT, BUILTIN_LE, BUILTIN_GT, BUILTIN_GE, BUILTIN_EQ, BUILTIN_NEQ,
+    LT_IF, LE_IF, GT_IF, GE_IF, EQ_IF, NEQ_IF,
+    // type-specialized operations that are only created by quickening while running
+    ADD_INT, SUB_INT, MUL_INT, LT_INT, LE_INT, GT_INT, GE_INT, EQ_INT, NEQ_INT,
+    ADD_FLOAT, SUB_FLOAT, MUL_FLOAT, DIV_FLOAT, LT_FLOAT, LE_FLOAT, GT_FLOAT, GE_FLOAT
 };
 static const std::string OperationTypeNames[] = {
     "not", "and", "or", "eq", "neq", "le", "ge", "lt", "gt", "add", "sub", "mul", "mmul",
@@ -61,12 +67,18 @@ static const std::string OperationTypeNames[] = {
     "call", "while", "if", "new", "print", "inline", "get", "set", "setfinal", "default",
     "time", "iter", "do", "catch", "fail", "exists", "read", "server", "AS", "range",
     "defer", "clear", "move", "ISCACHED", "sqlite", "graphics", "random",
-    "vector::consume", "vector::zero", "vector::alloc", "list::element", "list::gather"
+    "vector::consume", "vector::zero", "vector::alloc", "list::element", "list::gather", "stats",
+    "BUILTIN+add", "BUILTIN+sub", "BUILTIN+mul", "BUILTIN+lt", "BUILTIN+le", "BUILTIN+gt", "BUILTIN+ge", "BUILTIN+eq", "BUILTIN+neq",
+    "lt+if", "le+if", "gt+if", "ge+if", "eq+if", "neq+if",
+    "int::add", "int::sub", "int::mul", "int::lt", "int::le", "int::gt", "int::ge", "int::eq", "int::neq",
+    "float::add", "float::sub", "float::mul", "float::div", "float::lt", "float::le", "float::gt", "float::ge"
 };
 
 void initializeOperationMapping();
+static constexpr int OperationTypeCount = sizeof(OperationTypeNames)/sizeof(OperationTypeNames[0]);
 OperationType getOperationType(const std::string& str);
 std::string getOperationTypeName(OperationType type);
+uint64_t getOperationTableHash(); // changes whenever operations are added, removed, renamed, or reordered
 
 #define DEFAULT_LOCAL_EXPECTATION (size_t)32
 #define LOCAL_EXPECTATION_FROM_CODE(codeContext) std::min(1+(codeContext->getEnd() - codeContext->getStart()), DEFAULT_LOCAL_EXPECTATION)
@@ -237,6 +249,7 @@ public:
     inline bool existsAndTypeEquals(Datatype type) const;
     inline void existsAddOwner() const;
     inline void existsRemoveFromOwner();
+    inline void existsShare() const;
     inline bool isSame(const DataPtr& other) const;
     inline std::string torepr() const;
 
@@ -264,6 +277,8 @@ public:
     inline double unsafe_tofloat() const { return std::bit_cast<double>(data); }
     inline int64_t unsafe_toint() const { return data; }
     inline bool unsafe_tobool() const { return data; }
+    inline int64_t unsafe_raw() const { return data; }
+    inline DATTYPETYPE unsafe_type() const { return datatype; }
 
 
     inline bool isintint(const DataPtr& other) {return datatype & IS_INT & other.datatype;}
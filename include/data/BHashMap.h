@@ -21,10 +21,29 @@
 #include "Iterator.h"
 #include <memory>
 #include <mutex>
-#include "tsl/hopscotch_map.h"
+#include "tsl/robin_map.h"
 
+// literal keys hash to their bits, which are mixed so that strided integers do not fall into the same buckets
+struct MapKeyHash {
+    size_t operator()(const DataPtr& key) const {
+        if(!key.islit()) return key->toHash();
+        uint64_t bits = key.unsafe_toint();
+        bits ^= bits >> 33;
+        bits *= 0xff51afd7ed558ccdULL;
+        return bits ^ (bits >> 33);
+    }
+};
+struct MapKeyEqual {
+    bool operator()(const DataPtr& a, const DataPtr& b) const {return a.isSame(b);}
+};
+
+/**
+ * Maps are flat open-addressing tables that store each key, value, and truncated key hash inline,
+ * so lookups neither chase bucket nodes nor call toHash again for keys while the table grows.
+ */
 class BHashMap : public Data {
 public:
+    typedef tsl::robin_map<DataPtr, DataPtr, MapKeyHash, MapKeyEqual, std::allocator<std::pair<DataPtr, DataPtr>>, true> Contents;
     BHashMap();
     virtual ~BHashMap();
     std::string toString(BMemory* memory) override;
@@ -35,11 +54,13 @@ public:
     Result move(BMemory* memory) override;
     Result iter(BMemory* memory) override;
     void fastUnsafePut(const DataPtr& from, const DataPtr& to);
+    void reserve(size_t count);
+    void share() override;
     //Result implement(const OperationType operation, BuiltinArgs* args, BMemory* memory) override;
 
 private:
     mutable std::recursive_mutex memoryLock;
-    std::unordered_map<size_t, std::vector<std::pair<DataPtr, DataPtr>>> contents;
+    Contents contents;
     friend class MapIterator; 
 };
 
@@ -47,14 +68,14 @@ private:
 class MapIterator : public Iterator {
 private:
     BHashMap* map;
-    std::unordered_map<size_t, std::vector<std::pair<DataPtr, DataPtr>>>::iterator bucketIt;
-    int64_t elementIndex;
+    BHashMap::Contents::iterator it;
 
 public:
-    MapIterator(BHashMap* map_);
-    ~MapIterator() override = default;
+    MapIterator(BHashMap* map_); // keeps the map alive while iterating over it
+    ~MapIterator() override;
     Result next(BMemory* memory) override;
     Result iter(BMemory* memory) override;
+    void share() override;
 };
 
 #endif // BHASHMAP_H
@@ -23,19 +23,41 @@
 #include <mutex>
 
 
+/**
+ * Concatenated strings are ropes that keep their two parts and only copy characters into contents once they are
+ * flattened by indexing, hashing, comparisons, conversions, or printing. Concatenation joins the shallower part
+ * into the deeper one so that rope depth stays logarithmic, and ropes deeper than BSTRING_MAX_DEPTH are flattened
+ * anyway, which bounds the recursion needed to flatten or release them.
+ * String literals are interned, so that equal literals are the same object and compare by pointer.
+ */
 class BString : public Data {
 private:
-    std::string contents;
+    mutable std::string contents;
+    mutable std::atomic<size_t> hash; // computed on first use, zero until then
+    mutable BString* left;            // parts of ropes, which are released once flattened
+    mutable BString* right;
+    mutable std::atomic<bool> flat;
+    mutable std::recursive_mutex memoryLock;
+    size_t size;
+    int depth;
+    bool interned;
     explicit BString();
-    std::string& toString();
+    explicit BString(BString* left, BString* right);
+    static BString* concat(BString* left, BString* right);
+    static BString* balanced(BString* left, BString* right);
+    void flatten() const;
+    void appendTo(std::string& out) const;
+    const std::string& toString() const;
 public:
-    explicit BString(const std::string& val);
+    explicit BString(std::string val);
+    static BString* intern(const std::string& val); // the returned string is never released
     ~BString();
     bool isSame(const DataPtr& other) override;
     Result eq(BMemory *memory, const DataPtr& other) override;
     Result neq(BMemory *memory, const DataPtr& other) override;
     Result at(BMemory *memory, const DataPtr& other) override;
     size_t toHash() const override;
+    void share() override;
     std::string toString(BMemory* memory) override;
     int64_t toInt(BMemory *memory) override;
     int64_t len(BMemory *memory) override;
@@ -27,6 +27,7 @@
 class BMemory;
 class Command;
 class Jitable;
+class FrameLayout;
 
 struct SymbolWorries {
     int access;
@@ -53,9 +54,10 @@ private:
 public:
     bool scheduleForParallelExecution;
     Jitable* jitable;
+    const FrameLayout* layout; // dense slots for the symbols this block's frames assign (owned by the program)
     
     explicit Code(const std::vector<Command>* programAt, size_t startAt, size_t endAt, size_t premature_end);
-    Code* copy() const {Code* ret = new Code(program, start, end, premature_end);ret->jitable=jitable;ret->scheduleForParallelExecution=scheduleForParallelExecution; return ret;}
+    Code* copy() const {Code* ret = new Code(program, start, end, premature_end);ret->jitable=jitable;ret->layout=layout;ret->scheduleForParallelExecution=scheduleForParallelExecution; return ret;}
     std::string toString(BMemory* memory)override;
     size_t getStart() const;
     size_t getEnd() const;
@@ -23,8 +23,10 @@
 #include <string>
 #include <iostream>
 #include <atomic>
+#include <mutex>
 #include "common.h"
 #include "Result.h"
+#include "interpreter/Pool.h"
 
 class BMemory;
 class Data {
@@ -33,6 +35,8 @@ public:
 
     Data(Datatype type);
     virtual ~Data() = default;
+    static void* operator new(size_t size) {return poolAllocate(size);}
+    static void operator delete(void* ptr, size_t size) {poolRelease(ptr, size);}
 
     virtual size_t toHash() const;
     virtual bool isSame(const DataPtr& other);
@@ -76,14 +80,44 @@ public:
 
     virtual std::string toString(BMemory* memory)= 0;
     
-    inline void addOwner() {++referenceCounter;}
-    virtual void removeFromOwner() {if((--referenceCounter)==0) delete this;}
+    // objects that never left their thread update their counter without locked instructions
+    inline void addOwner() {
+        if(shared.load(std::memory_order_relaxed)) ++referenceCounter;
+        else referenceCounter.store(referenceCounter.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+    }
+    virtual void removeFromOwner() {
+        int remaining;
+        if(shared.load(std::memory_order_relaxed)) remaining = --referenceCounter;
+        else {
+            remaining = referenceCounter.load(std::memory_order_relaxed)-1;
+            referenceCounter.store(remaining, std::memory_order_relaxed);
+        }
+        if(remaining==0) delete this;
+    }
+    inline bool isShared() const {return shared.load(std::memory_order_relaxed);}
+    // switches to atomic counting before the object becomes reachable from other threads; containers also share their contents
+    virtual void share() {shared.store(true, std::memory_order_release);}
 protected:
     std::atomic<int> referenceCounter;
+    std::atomic<bool> shared;
 private:
     Datatype type;
 };
 
+/**
+ * Lock guard for the contents of objects that skips locking while they remain visible to only one thread.
+ * Objects are shared by the thread owning them, so this is only safe for operations that do not run
+ * user code, which could share the object midway, while holding the lock.
+ */
+class OwnedLock {
+    std::recursive_mutex* mutex;
+public:
+    inline OwnedLock(const Data* owner, std::recursive_mutex& mutex_) : mutex(owner->isShared()?&mutex_:nullptr) {if(mutex) mutex->lock();}
+    inline ~OwnedLock() {if(mutex) mutex->unlock();}
+    OwnedLock(const OwnedLock&) = delete;
+    OwnedLock& operator=(const OwnedLock&) = delete;
+};
+
 std::string DataPtr::torepr() const {
     if(datatype & IS_FLOAT) return std::to_string(unsafe_tofloat());
     if(datatype & IS_INT) return std::to_string(unsafe_toint());
@@ -109,6 +143,14 @@ void DataPtr::existsAddOwner() const {
     //std::cout << "Adding: "<<get()->toString(nullptr)<<"\n";
 }
 
+void DataPtr::existsShare() const {
+    if(datatype & IS_NOT_PTR) return;
+    if(data) {
+        Data* obj = std::bit_cast<Data*>(data);
+        if(!obj->isShared()) obj->share();
+    }
+}
+
 void DataPtr::existsRemoveFromOwner() {
     if(datatype & IS_NOT_PTR) return;
     if(data) {
@@ -19,6 +19,9 @@
 
 #include <memory>
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include "data/Data.h"
 #include "data/BError.h"
 #include "interpreter/Command.h"
@@ -27,27 +30,36 @@
 #include "data/Code.h"
 
 
-class ThreadResult {
+class ThreadResult : public std::enable_shared_from_this<ThreadResult> {
+private:
+    static constexpr int PENDING = 0;
+    static constexpr int RUNNING = 1;
+    static constexpr int DONE = 2;
+    std::atomic<int> state;
+    std::mutex doneLock;
+    std::condition_variable doneCondition;
+    unsigned int depth;
+    Code* code;
+    BMemory* memory;
+    const Command* command;
+    DataPtr thisObj;
 public:
-    std::thread thread;
     Result value;
-    ThreadResult():value(DataPtr::NULLP) {};
+    ThreadResult():state(DONE), depth(0), code(nullptr), memory(nullptr), command(nullptr), thisObj(DataPtr::NULLP), value(DataPtr::NULLP) {};
     ~ThreadResult() = default;
-    void start(unsigned int depth, Code* code, BMemory* newMemory, ThreadResult* futureResult, const Command* command, DataPtr thisObj) {
-        thread = std::thread(threadExecute, depth, code, newMemory, futureResult, command, thisObj);
-    }
+    void start(unsigned int depth, Code* code, BMemory* newMemory, const Command* command, DataPtr thisObj);
+    bool tryRun();
+    void wait();
 };
 
 
 class Future : public Data {
 private:
-    ThreadResult* result;
-    static std::atomic<int> thread_count;
-    static int max_threads;
+    std::shared_ptr<ThreadResult> result;
 
 public:
     Future();
-    explicit Future(ThreadResult* result);
+    explicit Future(std::shared_ptr<ThreadResult> result);
     ~Future();
 
     std::string toString(BMemory* memory)override;
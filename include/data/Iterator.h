@@ -34,6 +34,8 @@ public:
     virtual bool isContiguous() const {return false;}
     virtual int64_t getStart() const {bberror("Internal error: the chosen iterator type does not implement `getStart`, which means that `isContiguous` was not checked first.");}
     virtual int64_t getEnd() const {bberror("Internal error: the chosen iterator type does not implement `getEnd`, which means that `isContiguous` was not checked first.");}
+    virtual bool isStrided() const {return false;} // whether it visits every step-th integer starting from getStart
+    virtual int64_t getStep() const {bberror("Internal error: the chosen iterator type does not implement `getStep`, which means that `isStrided` was not checked first.");}
     virtual DataPtr fastNext() {return (Data*)nullptr;} // nullptr signifies to JIT that it needs to fallback to calling next();
     Result iter(BMemory* memory) override {return RESMOVE(Result(this));} // not virtual to not be overriden
 };
@@ -57,9 +59,10 @@ private:
     Data* object;
     int64_t pos;
 public:
-    explicit AccessIterator(DataPtr object_, int64_t size); // size should be equal to object_->len(memory) for the memory in which the iterator is being created
+    explicit AccessIterator(DataPtr object_, int64_t size); // size should be equal to object_->len(memory) for the memory in which the iterator is being created, and the object is kept alive while iterating
     ~AccessIterator();
     Result next(BMemory* memory) override;
+    void share() override {Data::share(); object->share();}
 };
 
 
@@ -77,6 +80,8 @@ public:
     bool isContiguous() const override {return step==1;}
     int64_t getStart() const override {std::lock_guard<std::recursive_mutex> lock(memoryLock);return first;}
     int64_t getEnd() const override {return last;}
+    bool isStrided() const override {return step>0;}
+    int64_t getStep() const override {return step;}
 };
 
 class FloatRange : public Iterator {
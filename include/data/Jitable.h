@@ -38,6 +38,8 @@ public:
     virtual ~Jitable() = default;
     virtual bool run(BMemory* memory, DataPtr& returnValue, bool &returnSignal, bool forceStayInThread) = 0;
     virtual bool runWithBooleanIntent(BMemory* memory, bool &returnValue, bool forceStayInThread) {return false;}
+    // runs all remaining iterations of a while loop with this body and the given condition
+    virtual bool runAsLoopBody(BMemory* memory, Jitable* condition, bool forceStayInThread) {return false;}
     virtual std::string toString() = 0;
 };
 
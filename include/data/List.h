@@ -27,13 +27,102 @@ class Graphics;
 class Vector;
 class BHashMap;
 
+/**
+ * Growable ring buffer of list elements with amortized constant time insertions and removals at both ends.
+ * Capacities are powers of two that double when full and halve when no more than a quarter is used,
+ * so that queues that push and pop elements neither move their contents nor keep memory they no longer need.
+ * While all elements share the same type tag (e.g., all ints, all floats, all bools, or all objects) only
+ * their 8-byte payloads are stored and the tag is kept once. The first element with a different tag
+ * deoptimizes storage to keep one tag per element.
+ */
+class ListContents {
+private:
+    int64_t* words;
+    DATTYPETYPE* tags; // nullptr while all elements share the type `kind`
+    DATTYPETYPE kind;
+    size_t capacity;
+    size_t head;
+    size_t count;
+    void reallocate(size_t newCapacity);
+    void generalize();
+    inline size_t slot(size_t i) const {return (head+i)&(capacity-1);}
+    inline void store(size_t pos, const DataPtr& value) {
+        if(tags && !count) {delete[] tags; tags = nullptr;}
+        words[pos] = value.unsafe_raw();
+        if(tags) tags[pos] = value.unsafe_type();
+        else if(value.unsafe_type()!=kind) {
+            if(!count) kind = value.unsafe_type();
+            else {generalize(); tags[pos] = value.unsafe_type();}
+        }
+    }
+public:
+    ListContents() : words(nullptr), tags(nullptr), kind(IS_PTR), capacity(0), head(0), count(0) {}
+    ListContents(ListContents&& other) noexcept;
+    ListContents& operator=(ListContents&& other) noexcept;
+    ListContents(const ListContents&) = delete;
+    ListContents& operator=(const ListContents&) = delete;
+    ~ListContents() {delete[] words; delete[] tags;}
+
+    inline size_t size() const {return count;}
+    inline bool empty() const {return !count;}
+    inline DataPtr operator[](size_t i) const {
+        size_t pos = slot(i);
+        return DataPtr(std::bit_cast<void*>(words[pos]), tags?tags[pos]:kind);
+    }
+    inline void set(size_t i, const DataPtr& value) {store(slot(i), value);}
+    inline DataPtr front() const {return (*this)[0];}
+    inline DataPtr back() const {return (*this)[count-1];}
+    inline void push_back(const DataPtr& value) {
+        if(count==capacity) reallocate(capacity?capacity*2:8);
+        store(slot(count), value);
+        ++count;
+    }
+    template <typename... Args> inline void emplace_back(Args&&... args) {push_back(DataPtr(std::forward<Args>(args)...));}
+    inline void push_front(const DataPtr& value) {
+        if(count==capacity) reallocate(capacity?capacity*2:8);
+        head = (head+capacity-1)&(capacity-1);
+        store(head, value);
+        ++count;
+    }
+    inline void pop_back() {--count; shrink();}
+    inline void pop_front() {head = slot(1); --count; shrink();}
+    inline void shrink() {if(capacity>16 && count<=capacity/4) reallocate(capacity/2);}
+    void reserve(size_t n);
+    void clear(); // also releases memory
+
+    /**
+     * Returns the tag shared by all elements, or zero if elements are stored with different tags.
+     * When non-zero, payloads can be read without per-element checks through `segment`.
+     */
+    inline DATTYPETYPE homogeneousType() const {return tags?0:kind;}
+    /**
+     * Contiguous payload spans of the ring buffer; part 0 starts at the first element and part 1 holds
+     * any elements that wrapped around to the start of storage.
+     */
+    inline const int64_t* segment(int part, size_t& length) const {
+        size_t first = std::min(count, capacity-head);
+        length = part?count-first:first;
+        return part?words:words+head;
+    }
+
+    class iterator {
+        const ListContents* contents;
+        size_t pos;
+    public:
+        iterator(const ListContents* contents, size_t pos) : contents(contents), pos(pos) {}
+        inline DataPtr operator*() const {return (*contents)[pos];}
+        inline iterator& operator++() {++pos; return *this;}
+        inline bool operator!=(const iterator& other) const {return pos!=other.pos;}
+    };
+    inline iterator begin() const {return iterator(this, 0);}
+    inline iterator end() const {return iterator(this, count);}
+};
+
 class BList : public Data {
 private:
     mutable std::recursive_mutex memoryLock; 
-    int64_t front;
-    void resizeContents();
 public:
-    std::vector<DataPtr> contents;
+    ListContents contents;
     
     explicit BList();
     explicit BList(int64_t reserve);
@@ -56,6 +145,7 @@ public:
     Result iter(BMemory* memory) override;
     Result min(BMemory* memory) override;
     Result max(BMemory* memory) override;
+    void share() override;
 
     friend class Graphics;
 };
@@ -20,12 +20,42 @@
 #include <memory>
 #include <string>
 #include <mutex>
+#include <vector>
 #include "data/Data.h"
 #include "BMemory.h"
 
+/**
+ * Hidden class shared by all structs whose fields were added in the same order, which is
+ * the case for structs created by the same `new` block. Shapes are immutable and never freed;
+ * adding a field follows (and caches) a transition to the shape with that field appended.
+ */
+class StructShape {
+private:
+    tsl::hopscotch_map<int, int> slots;
+    mutable std::mutex transitionLock;
+    mutable tsl::hopscotch_map<int, StructShape*> transitions;
+    StructShape(const StructShape* prev, int field);
+public:
+    const unsigned int id;
+    std::vector<int> fields;
+    StructShape();
+    static const StructShape* empty();
+    const StructShape* withField(int field) const;
+    inline int slot(int field) const {
+        if(fields.size()<=8) {
+            for(unsigned int i=0;i<fields.size();++i) if(fields[i]==field) return i;
+            return -1;
+        }
+        auto it = slots.find(field);
+        return it==slots.end()?-1:it->second;
+    }
+};
+
 class Struct : public Data {
 private:
-    tsl::hopscotch_map<int, DataPtr> data;
+    const StructShape* shape;
+    std::vector<DataPtr> fields;
+    int addField(int id);
     Result simpleImplement(int implementationCode, BMemory* scopeMemory);
     Result simpleImplement(int implementationCode, BMemory* scopeMemory, const DataPtr& other);
     void releaseMemory();
@@ -39,6 +69,9 @@ public:
     void set(int id, const DataPtr& other);
     void transferNoChecks(int id, const DataPtr& other);
     void transferToMemory(BMemory* scopeMemory);
+    inline const StructShape* getShape() const {return shape;}
+    inline const DataPtr& getAt(int slot) const {return fields[slot];}
+    void setAt(int slot, const DataPtr& other);
 
     Result push(BMemory* scopeMemory, const DataPtr& other) override;
     Result pop(BMemory* scopeMemory) override;
@@ -77,6 +110,7 @@ public:
     Result logarithm(BMemory* scopeMemory) override;
     Result sum(BMemory* scopeMemory) override;
     Result opnot(BMemory* scopeMemory) override;
+    void share() override;
 };
 
 #endif // STRUCT_H
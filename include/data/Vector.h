@@ -20,18 +20,45 @@
 #include <memory>
 #include <string>
 #include <mutex>
+#include <vector>
 #include "data/Data.h"
 
+class VectorExpression;
+
+/**
+ * Elementwise arithmetic on large vectors is deferred: results only record the expression that computes them,
+ * and chains of operations are evaluated together in one tiled pass once a value is indexed, printed, reduced,
+ * or stored into a container. Slicing by ranges creates views that read from the parent's buffer with an offset
+ * and a step. Buffers are shared with pending expressions and views, and copied before being written to.
+ * Large vectors are evaluated and reduced by multiple threads, with sums that do not depend on their number.
+ */
 class Vector : public Data {
 private:
-    double* data;
+    std::shared_ptr<double[]> buffer;
+    double* data;    // first element, which views place within a parent's buffer
     uint64_t size;
+    int64_t step;    // distance between consecutive elements, which is not one only for strided views
+    std::vector<int64_t> shape;   // dimensions, with elements laid out in row-major order
+    std::vector<int64_t> strides; // elements skipped when advancing along each dimension
+    std::shared_ptr<VectorExpression> pending;
+    int pendingUses; // values that are used more than once are materialized instead of being evaluated again
     mutable std::recursive_mutex memoryLock;
+    explicit Vector(const std::shared_ptr<VectorExpression>& pending);
+    explicit Vector(const std::shared_ptr<double[]>& buffer, double* data, const std::vector<int64_t>& shape);
+    explicit Vector(const std::shared_ptr<double[]>& buffer, double* data, uint64_t size, int64_t step);
+    void compact();
+    Result elementwise(int operation, const DataPtr& other, const char* name);
+    Result reduce(int reduction);
 
 public:
     explicit Vector(uint64_t size);
     explicit Vector(uint64_t size, bool setToZero);
     ~Vector();
+    void materialize();
+    static void setMaxThreads(int maxThreads);
+    static long long materializations();
+    Result getShape(BMemory* memory);
+    Result reshape(BMemory* memory, const std::vector<int64_t>& dims);
 
     std::string toString(BMemory* memory)override;
 
@@ -47,7 +74,7 @@ public:
     Result rdiv(BMemory* memory, const DataPtr& other) override;
     Result pow(BMemory* memory, const DataPtr& other) override;
     Result rpow(BMemory* memory, const DataPtr& other) override;
-    //Result mmul(BMemory* memory, const DataPtr& other) override;
+    Result mmul(BMemory* memory, const DataPtr& other) override;
     Result lt(BMemory* memory, const DataPtr& other) override;
     Result le(BMemory* memory, const DataPtr& other) override;
     Result gt(BMemory* memory, const DataPtr& other) override;
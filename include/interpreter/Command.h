@@ -19,7 +19,10 @@
 
 #include <string>
 #include <vector>
+#include <deque>
 #include <memory>
+#include <atomic>
+#include <cstdint>
 #include "common.h"
 #include "data/Data.h"
 
@@ -35,20 +38,140 @@ public:
     explicit CommandContext(const std::string& source);
 };
 
-class Command {
+class CommandDebugInfo {
 public:
-    OperationType operation;
-    std::vector<int> args;
-    int nargs;
-    mutable DataPtr value;
     int line;
     std::shared_ptr<SourceFile> source;
     std::shared_ptr<CommandContext> descriptor;
+};
+
+/**
+ * Debug information of the commands of one program, which is owned next to the program and released with it.
+ * Entries never move once added, so commands point to them directly. Tables are not synchronized: programs
+ * decoded in parallel fill one table per thread and absorb them into the program's table afterwards.
+ */
+class CommandDebugTable {
+private:
+    std::deque<CommandDebugInfo> entries;
+    std::deque<std::deque<CommandDebugInfo>> absorbed;
+public:
+    inline const CommandDebugInfo* add(const std::shared_ptr<SourceFile>& source, int line, const std::shared_ptr<CommandContext>& descriptor) {
+        entries.push_back(CommandDebugInfo{line, source, descriptor});
+        return &entries.back();
+    }
+    inline void absorb(CommandDebugTable& other) {
+        absorbed.emplace_back().swap(other.entries); // swapping keeps the addresses of entries
+        for(auto& part : other.absorbed) absorbed.emplace_back().swap(part);
+        other.absorbed.clear();
+    }
+};
+
+#define COMMAND_INLINE_ARGS 5
+
+/**
+ * Fixed-width operand storage of a Command. The first operands are stored inline so that
+ * the interpreter never needs to chase a pointer for them; only instructions with long
+ * argument lists (e.g., list creation or print) place the remaining operands on the heap.
+ */
+class CommandArgs {
+private:
+    int* overflow;
+    int inlined[COMMAND_INLINE_ARGS];
+    int count;
+public:
+    class const_iterator {
+        const CommandArgs* args;
+        int pos;
+    public:
+        const_iterator(const CommandArgs* args, int pos) : args(args), pos(pos) {}
+        inline int operator*() const {return (*args)[pos];}
+        inline const_iterator& operator++() {++pos; return *this;}
+        inline bool operator!=(const const_iterator& other) const {return pos!=other.pos;}
+        inline bool operator==(const const_iterator& other) const {return pos==other.pos;}
+    };
+    CommandArgs() : overflow(nullptr), count(0) {}
+    CommandArgs(const CommandArgs& other);
+    CommandArgs(CommandArgs&& other) noexcept;
+    CommandArgs& operator=(const CommandArgs& other);
+    CommandArgs& operator=(CommandArgs&& other) noexcept;
+    ~CommandArgs() {delete[] overflow;}
+    void assign(const std::vector<int>& values);
+    inline int operator[](int i) const {return i<COMMAND_INLINE_ARGS?inlined[i]:overflow[i-COMMAND_INLINE_ARGS];}
+    inline void set(int i, int value) {if(i<COMMAND_INLINE_ARGS) inlined[i] = value; else overflow[i-COMMAND_INLINE_ARGS] = value;}
+    inline int size() const {return count;}
+    inline const_iterator begin() const {return const_iterator(this, 0);}
+    inline const_iterator end() const {return const_iterator(this, count);}
+};
 
-    Command(const std::string& command, const std::shared_ptr<SourceFile>& source, int line, const std::shared_ptr<CommandContext>& descriptor);
+/**
+ * Commands are packed fixed-width instructions (operation, operands, and a precomputed value)
+ * that the interpreter walks contiguously. Source line, file, and descriptor are kept in the
+ * CommandDebugTable of the program and only looked up through debug() when error messages are created.
+ */
+#define FIELD_CACHE_WAYS 2
+
+/**
+ * Inline cache of struct field slots for field access instructions. Each way packs a struct
+ * shape id with the slot that the accessed field occupies in structs of that shape, so that
+ * repeated accesses on structs created by the same code skip the field lookup altogether.
+ * Ways are read and written atomically because the same instruction may run in several threads.
+ */
+class FieldCache {
+private:
+    mutable uint64_t ways[FIELD_CACHE_WAYS];
+public:
+    FieldCache() : ways{} {}
+    FieldCache(const FieldCache& other) : ways{} {}
+    inline int lookup(unsigned int shapeId) const {
+        for(int way=0;way<FIELD_CACHE_WAYS;++way) {
+            uint64_t entry = std::atomic_ref<uint64_t>(ways[way]).load(std::memory_order_relaxed);
+            if(static_cast<unsigned int>(entry>>32)==shapeId) return static_cast<int>(static_cast<uint32_t>(entry));
+        }
+        return -1;
+    }
+    inline void store(unsigned int shapeId, int slot) const {
+        uint64_t entry = (static_cast<uint64_t>(shapeId)<<32) | static_cast<uint32_t>(slot);
+        for(int way=0;way<FIELD_CACHE_WAYS-1;++way) {
+            uint64_t expected = 0;
+            if(std::atomic_ref<uint64_t>(ways[way]).compare_exchange_strong(expected, entry, std::memory_order_relaxed)) return;
+        }
+        // polymorphic beyond the available ways: keep replacing the last one
+        std::atomic_ref<uint64_t>(ways[FIELD_CACHE_WAYS-1]).store(entry, std::memory_order_relaxed);
+    }
+};
+
+class Command {
+public:
+    mutable OperationType operation;
+    mutable bool deoptimized;
+    const CommandDebugInfo* debugInfo;
+    CommandArgs args;
+    mutable DataPtr value;
+    FieldCache fieldCache;
+
+    Command(const std::string& command, const std::shared_ptr<SourceFile>& source, int line, const std::shared_ptr<CommandContext>& descriptor, CommandDebugTable& debugTable);
+    Command(OperationType operation, const std::vector<int>& args, const DataPtr& value, const std::shared_ptr<SourceFile>& source, int line, const std::shared_ptr<CommandContext>& descriptor, CommandDebugTable& debugTable);
+    static std::vector<std::string> split(const std::string& command);
+    static DataPtr parseBuiltin(std::string raw);
     ~Command();
+    inline const CommandDebugInfo& debug() const {return *debugInfo;}
     std::string toString() const;
     std::string tocpp(bool first_assignment) const;
+
+    /**
+     * Arithmetic and comparisons are quickened into type-specialized operations once they see operands of the
+     * specialized type, and deoptimized back to their generic operation for good on the first mismatch. The
+     * operation is read and written atomically because the same instruction may run in several threads.
+     */
+    inline OperationType dispatched() const {return std::atomic_ref<OperationType>(operation).load(std::memory_order_relaxed);}
+    inline void quicken(OperationType generic, OperationType specialized) const {
+        if(std::atomic_ref<bool>(deoptimized).load(std::memory_order_relaxed) || dispatched()!=generic) return;
+        std::atomic_ref<OperationType>(operation).store(specialized, std::memory_order_relaxed);
+    }
+    inline void deoptimize(OperationType generic) const {
+        std::atomic_ref<bool>(deoptimized).store(true, std::memory_order_relaxed);
+        std::atomic_ref<OperationType>(operation).store(generic, std::memory_order_relaxed);
+    }
 };
 
 #endif // COMMAND_H
@@ -0,0 +1,51 @@
+/*
+   Copyright 2024 Emmanouil Krasanakis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <cstddef>
+#include <new>
+
+#define POOL_GRANULARITY 16
+#define POOL_CLASSES 16
+#define POOL_SLAB_BLOCKS 64
+#define POOL_MAX_THREAD_BLOCKS 1024
+
+/**
+ * Size-class pools for the small objects that the interpreter creates and destroys at a high rate,
+ * namely Data objects (e.g., strings, lists, structs, iterators) and the slot arrays of BMemory frames.
+ * Each thread keeps its own free lists, so allocation and release do not contend across threads.
+ * Blocks released by a thread are returned to a shared depot only when its lists grow too long or
+ * when the thread exits. Requests larger than the largest size class fall back to the global heap.
+ */
+void* poolAllocate(size_t size);
+void poolRelease(void* ptr, size_t size);
+
+template <typename T>
+class PoolAllocator {
+public:
+    using value_type = T;
+    PoolAllocator() noexcept = default;
+    template <typename U> PoolAllocator(const PoolAllocator<U>&) noexcept {}
+    T* allocate(size_t n) {return static_cast<T*>(poolAllocate(n*sizeof(T)));}
+    void deallocate(T* ptr, size_t n) noexcept {poolRelease(ptr, n*sizeof(T));}
+    template <typename U> bool operator==(const PoolAllocator<U>&) const noexcept {return true;}
+    template <typename U> bool operator!=(const PoolAllocator<U>&) const noexcept {return false;}
+};
+
+#endif // POOL_H
@@ -0,0 +1,73 @@
+/*
+   Copyright 2024 Emmanouil Krasanakis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadResult;
+
+/**
+ * Persistent pool of workers that run function calls marked with Code::scheduleForParallelExecution.
+ * Each worker owns a deque: it pushes and pops its own tasks from the back, whereas idle workers
+ * steal from the front of others. Threads that are not workers submit to a shared injection queue.
+ * Tasks are claimed atomically by ThreadResult::tryRun, so a task that was already picked up by a
+ * waiting Future::getResult is simply skipped when dequeued later.
+ */
+class ThreadPool {
+private:
+    struct WorkerQueue {
+        std::mutex lock;
+        std::deque<std::shared_ptr<ThreadResult>> tasks;
+    };
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex injectionLock;
+    std::deque<std::shared_ptr<ThreadResult>> injected;
+    std::mutex idleLock;
+    std::condition_variable idleCondition;
+    std::atomic<int> pending;
+    std::atomic<long long> submittedTasks;
+    std::atomic<bool> stopping;
+    static thread_local int workerIndex;
+    static thread_local int helpDepth;
+
+    std::shared_ptr<ThreadResult> take(int index);
+    void workerLoop(int index);
+    void stop();
+
+public:
+    ThreadPool();
+    ~ThreadPool();
+    void resize(int numWorkers);
+    int size() const {return workers.size();}
+    long long submitted() const {return submittedTasks.load(std::memory_order_relaxed);}
+    static bool isWorker() {return workerIndex>=0;}
+    bool acceptsTask() const;
+    void submit(std::shared_ptr<ThreadResult> task);
+    bool help();
+};
+
+extern ThreadPool threadPool;
+
+#endif // THREAD_POOL_H
@@ -20,6 +20,7 @@
 #include <string>
 #include <vector>
 #include <deque>
+#include <cstdint>
 
 class Token {
 public:
@@ -37,12 +38,41 @@ public:
     std::string toString() const;
 };
 
+/**
+ * Source files read while compiling a program alongside hashes of their contents. These are stored in
+ * compiled .bbvm files so that programs are recompiled only when one of their sources or the compilation
+ * options change. Permissions granted by the main file are stored too, because they also apply when running.
+ * Programs that run !comptime code are never considered up-to-date, because that code may depend on more
+ * than the sources.
+ */
+class CompiledSources {
+public:
+    struct Entry {
+        std::string path;
+        uint64_t low, high;
+    };
+    std::vector<Entry> files;
+    std::vector<std::string> access;
+    std::vector<std::string> modify;
+    std::string options;
+    bool cacheable = true;
+    void reset();
+    Entry add(const std::string& path, const std::string& contents);
+    static Entry hash(const std::string& path, const std::string& contents);
+};
+extern CompiledSources compiledSources;
+
  
 std::string read_decompressed(const std::string& source);
 std::string cleanSymbols(const std::string& code, int& uniqueSymbolCounter);
 void compile(const std::string& source, const std::string& destination);
 void optimize(const std::string& source, const std::string& destination, bool minimify, bool compress);
 std::string read_decompressed(const std::string& source);
+void write_bbvm(const std::string& destination, const std::string& code, bool validate);
+std::string read_bbvm(const std::string& source);
+bool is_binary_bbvm(const std::string& contents);
+bool is_binary_bbvm_file(const std::string& source);
+bool reuse_up_to_date_bbvm(const std::string& source, const std::string& destination);
 std::vector<Token> tokenize(const std::string& text, const std::string& file, bool injectStandardLibrary=false);
 
 void ltrim(std::string &s);
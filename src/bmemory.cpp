@@ -26,6 +26,7 @@
 #include <bit>
 #include <xmmintrin.h>
 #include <new>     // For std::align
+#include <algorithm>
 
 
 std::string indentNewlines(const std::string& input) {
@@ -51,10 +52,28 @@ void BMemory::verify_noleaks() {
     bbassert(countUnreleased == 1, "There are " + std::to_string(countUnreleased-1) + " leftover memory contexts leaked");  // the main memory is a global object (needed to sync threads on errors)
 }
 
-BMemory::BMemory(unsigned int depth, BMemory* par, int expectedAssignments) : depth(depth), parent(par), allowMutables(true), first_item(INT_MAX), hasAtLeastOneFinal(false) { 
+FrameLayout::FrameLayout(const std::vector<int>& assignedSymbols) : mask(0) {
+    std::unordered_set<int> added;
+    for(int symbol : assignedSymbols) 
+        if(symbol>variableManager.maximumReservedId && added.insert(symbol).second) 
+            symbols.push_back(symbol);
+    if(symbols.empty()) return;
+    unsigned int capacity = 4;
+    while(capacity<symbols.size()*2) capacity *= 2;
+    mask = capacity-1;
+    table.resize(capacity, {-1, -1});
+    for(unsigned int i=0;i<symbols.size();++i) {
+        unsigned int pos = (static_cast<unsigned int>(symbols[i])*2654435761u) & mask;
+        while(table[pos].first!=-1) pos = (pos+1) & mask;
+        table[pos] = {symbols[i], static_cast<int>(i)};
+    }
+}
+
+BMemory::BMemory(unsigned int depth, BMemory* par, int expectedAssignments, const FrameLayout* layout) : depth(depth), parent(par), allowMutables(true), first_item(INT_MAX), hasAtLeastOneFinal(false), sharedReaders(0), layout(layout) { 
     ++countUnrealeasedMemories;
-    cache_size = expectedAssignments;
-    cache = new DataPtr[cache_size]();
+    cache_size = layout?layout->size():expectedAssignments;
+    cache = cache_size?static_cast<DataPtr*>(poolAllocate(cache_size*sizeof(DataPtr))):nullptr;
+    for(unsigned int i=0;i<cache_size;++i) new (&cache[i]) DataPtr();
     //for(int i=0;i<cache_size;++i) cache[i] = DataPtr::NULLP;  // TODO: find a way to reduce these operations?
 }
 
@@ -89,8 +108,9 @@ void BMemory::release() {
         catch(const BBError& e) {destroyerr += std::string(e.what())+"\n";}
     }
     data.clear();
+    if(cache) poolRelease(cache, cache_size*sizeof(DataPtr));
+    cache = nullptr;
     cache_size = 0;
-    if(cache_size) delete[] cache;
     if(destroyerr.size()) throw BBError(destroyerr.substr(0, destroyerr.size()-1));
 }
 
@@ -109,25 +129,94 @@ void BMemory::resolveFuture(DataPtr& ret) {
 
     bool prevFinal = ret.isA();
     value.setA(prevFinal);
-    ret = value;
+    if(isShared()) {
+        value.existsShare();
+        std::unique_lock<std::shared_mutex> lock(sharedLock);
+        ret = value;
+    }
+    else ret = value;
     prevRet->removeFromOwner();
 }
 
 
-const DataPtr& BMemory::get(int item, bool allowMutable) {
-    auto& ret = find(item);
-    if(ret.existsAndTypeEquals(FUTURE)) [[unlikely]] {
-        resolveFuture(ret);
+void BMemory::markShared() {
+    // called before submitting a call that may read this memory (or its parents) from a worker; only the owning
+    // thread can start sharing a memory, as other threads reach it only through calls that already share it
+    for(BMemory* mem = this; mem; mem = mem->parent) 
+        if(mem->sharedReaders.fetch_add(1, std::memory_order_acq_rel)==0) mem->shareValues();
+}
+
+void BMemory::unmarkShared() {
+    // called by workers when their call ends, so that memories go back to unlocked access once all such calls join
+    for(BMemory* mem = this; mem; mem = mem->parent) mem->sharedReaders.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void BMemory::shareValues() {
+    // values set afterwards are shared by set operations while there are readers
+    for(unsigned int i=0;i<cache_size;++i) cache[i].existsShare();
+    for(const auto& dat : data) dat.second.existsShare();
+}
+
+DataPtr& BMemory::findShared(int item) {
+    // only the owning thread mutates, so it can look up without locking but needs exclusive access to insert
+    DataPtr* ret = findExisting(item);
+    if(ret) return *ret;
+    std::unique_lock<std::shared_mutex> lock(sharedLock);
+    if(item<=variableManager.maximumReservedId) return data[item];
+    if(layout) return data[item]; // symbols with slots were already found above
+    if(first_item==INT_MAX) first_item = item;
+    int tentativeidx = item-first_item;
+    if(static_cast<unsigned int>(tentativeidx)>=cache_size) return data[item];
+    return cache[tentativeidx];
+}
+
+DataPtr BMemory::getShared(int item, bool allowMutable, bool orNull) {
+    // values are copied while holding the lock, because the owner may overwrite slots or rehash
+    DataPtr value;
+    {
+        std::shared_lock<std::shared_mutex> lock(sharedLock);
+        DataPtr* slot = findExisting(item);
+        value = slot?*slot:DataPtr::NULLP;
+    }
+    if(value.existsAndTypeEquals(FUTURE) && (allowMutable || value.isA())) [[unlikely]] {
+        Future* future = static_cast<Future*>(value.get());
+        Result resVal = future->getResult();
+        bool prevFinal = value.isA();
+        value = resVal.get();
+        value.setA(prevFinal);
+        std::unique_lock<std::shared_mutex> lock(sharedLock);
+        DataPtr* slot = findExisting(item);
+        if(slot && slot->exists() && slot->get()==future) {
+            value.existsAddOwner();
+            *slot = value;
+            future->removeFromOwner();
+        }
+    }
+    if(value.islitorexists()) [[likely]] {
+        if(orNull) {bbassert(allowMutable || value.isA(), "Mutable symbol cannot be accessed from a nested block: " + variableManager.getSymbol(item));}
+        else {bbassert(allowMutable || value.isA(), "Non-final symbol found but cannot be accessed from another scope: " + variableManager.getSymbol(item));}
+    }
+    else if(parent) return orNull?parent->getOrNull(item, allowMutables && allowMutable):parent->get(item, allowMutables && allowMutable);
+    else if(!orNull) bberror("Missing value: " + variableManager.getSymbol(item));
+    return value;
+}
+
+DataPtr BMemory::get(int item, bool allowMutable) {
+    if(isShared()) [[unlikely]] return getShared(item, allowMutable, false);
+    DataPtr* ret = findExisting(item);
+    if(ret && ret->existsAndTypeEquals(FUTURE)) [[unlikely]] {
+        resolveFuture(*ret);
         return get(item, allowMutable);
     }
-    if(ret.islitorexists()) [[likely]] {bbassert(allowMutable || ret.isA(), "Non-final symbol found but cannot be accessed from another scope: " + variableManager.getSymbol(item));}
+    if(ret && ret->islitorexists()) [[likely]] {bbassert(allowMutable || ret->isA(), "Non-final symbol found but cannot be accessed from another scope: " + variableManager.getSymbol(item));}
     else if(parent) return parent->get(item, allowMutables && allowMutable);
     else bberror("Missing value: " + variableManager.getSymbol(item));
-    return ret;
+    return *ret;
 }
 
 const DataPtr& BMemory::getShallow(int item) {
     auto& ret = find(item);
+    if(ret.existsAndTypeEquals(FUTURE)) [[unlikely]] resolveFuture(ret);
     if(ret.islitorexists()) return ret;
     bberror("Missing value: " + variableManager.getSymbol(item));
 }
@@ -136,11 +225,17 @@ const DataPtr& BMemory::getOrNullShallow(int item) {
     return find(item);
 }
 
-const DataPtr& BMemory::getOrNull(int item, bool allowMutable) {
-    auto& ret = find(item);
-    if (ret.islitorexists()) [[likely]] {bbassert(allowMutable || ret.isA(), "Mutable symbol cannot be accessed from a nested block: " + variableManager.getSymbol(item));}
+DataPtr BMemory::getOrNull(int item, bool allowMutable) {
+    if(isShared()) [[unlikely]] return getShared(item, allowMutable, true);
+    DataPtr* ret = findExisting(item);
+    if(!ret) {
+        if(parent) return parent->getOrNull(item, allowMutables && allowMutable);
+        return DataPtr::NULLP;
+    }
+    if(ret->existsAndTypeEquals(FUTURE)) [[unlikely]] resolveFuture(*ret);
+    if (ret->islitorexists()) [[likely]] {bbassert(allowMutable || ret->isA(), "Mutable symbol cannot be accessed from a nested block: " + variableManager.getSymbol(item));}
     else if (parent) return parent->getOrNull(item, allowMutables && allowMutable);
-    return ret;
+    return *ret;
 }
 
 void BMemory::setToNullIgnoringFinals(int item) {
@@ -150,8 +245,9 @@ void BMemory::setToNullIgnoringFinals(int item) {
         //if(prevData->getType()==ERRORTYPE && !static_cast<BError*>(prevData)->isConsumed()) bberror("Trying to overwrite an unhandled error:\n"+prevData->toString(this));
         prevData->removeFromOwner();
     }*/
-    prev.existsRemoveFromOwner();
-    prev = DataPtr::NULLP;
+    DataPtr previous = prev;
+    store(prev, DataPtr::NULLP);
+    previous.existsRemoveFromOwner();
 }
 
 void BMemory::set(int item, const DataPtr& value) {
@@ -162,10 +258,13 @@ void BMemory::set(int item, const DataPtr& value) {
                 static_cast<BError*>(prev.get())->consume()->toString(this)+
                 "\n \033[33m !!! \033[0mAt this point, the error is returned because it was never caught"
                 "\n      but was going to be hidden due to overwriting it with a new value\n      by the next instruction in the trace.");
+    if(isShared()) [[unlikely]] value.existsShare();
     value.existsAddOwner();
-    prev.existsRemoveFromOwner();
-    prev = value;
-    prev.setAFalse();
+    DataPtr previous = prev;
+    DataPtr stored = value;
+    stored.setAFalse();
+    store(prev, stored);
+    previous.existsRemoveFromOwner();
 }
 
 void BMemory::setFuture(int item, const DataPtr& value) {  // value.exists() == true always considering that this will be a valid future objhect
@@ -176,10 +275,13 @@ void BMemory::setFuture(int item, const DataPtr& value) {  // value.exists() ==
                 static_cast<BError*>(prev.get())->consume()->toString(this)+
                 "\n \033[33m !!! \033[0mAt this point, the error is returned because it was never caught"
                 "\n      but was going to be hidden due to overwriting it with a new value\n      by the next instruction in the trace.");
+    if(isShared()) [[unlikely]] value->share();
     value->addOwner();
-    prev.existsRemoveFromOwner();
-    prev = DataPtr(value); //std::move(DataPtr(value.get(), IS_FUTURE));
-    prev.setAFalse();
+    DataPtr previous = prev;
+    DataPtr stored = value;
+    stored.setAFalse();
+    store(prev, stored);
+    previous.existsRemoveFromOwner();
 }
 
 void BMemory::unsafeSet(int item, const DataPtr& value) {
@@ -190,12 +292,13 @@ void BMemory::unsafeSet(int item, const DataPtr& value) {
                 static_cast<BError*>(prev.get())->consume()->toString(this)+
                 "\n \033[33m !!! \033[0mAt this point, the error is returned because it was never caught"
                 "\n      but was going to be hidden due to overwriting it with a new value\n      by the next instruction in the trace.");
+    if(isShared()) [[unlikely]] value.existsShare();
     value.existsAddOwner();
-    prev.existsRemoveFromOwner();
-
-    /*f(value.existsAndTypeEquals(FUTURE)) prev = DataPtr(value.get(), IS_FUTURE);
-    else*/ prev = value;
-    prev.setA(prevFinal);
+    DataPtr previous = prev;
+    DataPtr stored = value;
+    stored.setA(prevFinal);
+    store(prev, stored);
+    previous.existsRemoveFromOwner();
 }
 
 void BMemory::directTransfer(Struct* to) {
@@ -204,7 +307,7 @@ void BMemory::directTransfer(Struct* to) {
     for(int idx=0;idx<cache_size;++idx) {
         auto& dat = cache[idx];
         if (dat.islitorexists()) {
-            int item = idx + first_item;
+            int item = symbolAt(idx);
             if(variableManager.getIdRetain(item)) {
                 to->transferNoChecks(item, dat);
                 dat = DataPtr::NULLP;
@@ -223,7 +326,9 @@ void BMemory::directTransfer(Struct* to) {
 }
 
 void BMemory::directTransfer(int to, int from) {
-    const auto& value = get(from);
+    // pending local futures are moved as they are so that the call keeps running in parallel
+    const DataPtr& local = find(from);
+    const auto& value = local.existsAndTypeEquals(FUTURE)?local:get(from);
     auto& prev = find(to);
     if(prev.isA()) bberror("Cannot overwrite final value: " + variableManager.getSymbol(to));
     if(prev.existsAndTypeEquals(ERRORTYPE) && !static_cast<BError*>(prev.get())->isConsumed()) 
@@ -232,22 +337,26 @@ void BMemory::directTransfer(int to, int from) {
                 "\n \033[33m !!! \033[0mAt this point, the error is returned because it was never caught"
                 "\n      but was going to be hidden due to overwriting it with a new value\n      by the next instruction in the trace.");
     
+    if(isShared()) [[unlikely]] value.existsShare();
     value.existsAddOwner();
     /*if(prev.exists()) {
         if(prev->getType()==FUTURE) {static_cast<Future*>(prev.get())->getResult();}
         prev->removeFromOwner();
     }*/
-    prev.existsRemoveFromOwner();
-
-    prev = value;
-    prev.setAFalse();
+    DataPtr previous = prev;
+    DataPtr stored = value;
+    stored.setAFalse();
+    store(prev, stored);
+    previous.existsRemoveFromOwner();
 }
 
 void BMemory::setFinal(int item) {
     //await();
     auto& value = find(item);
     bbassert(value.islitorexists(), "Missing variable cannot be set to final: "+variableManager.getSymbol(item));
-    value.setA(true);
+    DataPtr stored = value;
+    stored.setA(true);
+    store(value, stored);
     hasAtLeastOneFinal = true;
 }
 
@@ -255,7 +364,7 @@ void BMemory::pull(BMemory* other) {
     for(int idx=0;idx<other->cache_size;++idx) {
         const auto& dat = other->cache[idx];
         if (dat.islitorexists()) {
-            int item = idx + other->first_item;
+            int item = other->symbolAt(idx);
             set(item, dat);
         }
     }
@@ -266,11 +375,11 @@ void BMemory::pull(BMemory* other) {
 }
 
 void BMemory::replaceMissing(BMemory* other) {
-    for(unsigned int idx=0;idx<cache_size;++idx) {
+    for(unsigned int idx=0;idx<other->cache_size;++idx) {
         const auto& dat = other->cache[idx];
         if (dat.islitorexists()) {
             //this can not be stored in the first cache element anyway
-            int item = idx + other->first_item;
+            int item = other->symbolAt(idx);
             if(!getOrNullShallow(item).islitorexists()) set(item, dat);
         }
     }
@@ -350,15 +459,17 @@ void BMemory::await() {
     attached_threads.clear();
 
     for(unsigned int i=0;i<cache_size;++i) {
-        const auto& dat = cache[i];
+        auto& dat = cache[i];
+        if (dat.existsAndTypeEquals(FUTURE)) resolveFuture(dat);
         if (dat.existsAndTypeEquals(ERRORTYPE) && !static_cast<BError*>(dat.get())->isConsumed())  {
             static_cast<BError*>(dat.get())->consume();
             destroyerr += "\n"+dat->toString(this);
             counterr++;
         }
     }
-    for (const auto& dat_ : data) {
-        const auto& dat = dat_.second;
+    for (auto it = data.begin(); it != data.end(); ++it) {
+        auto& dat = it.value();
+        if (dat.existsAndTypeEquals(FUTURE)) resolveFuture(dat);
         if (dat.existsAndTypeEquals(ERRORTYPE) && !static_cast<BError*>(dat.get())->isConsumed())  {
             static_cast<BError*>(dat.get())->consume();
             destroyerr += "\n"+dat->toString(this);
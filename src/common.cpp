@@ -62,4 +62,14 @@ OperationType getOperationType(const std::string &str) {
 }
 
 std::string getOperationTypeName(OperationType type) {return OperationTypeNames[type];}
+uint64_t getOperationTableHash() {
+    // 64-bit FNV-1a over all operation names, which compiled programs store to detect a different numbering
+    uint64_t hash = 14695981039346656037ULL;
+    for(const std::string& name : OperationTypeNames) 
+        for(unsigned char c : name+'\0') {
+            hash ^= c;
+            hash *= 1099511628211ULL;
+        }
+    return hash;
+}
 DataPtr DataPtr::NULLP((Data*)nullptr);
\ No newline at end of file
@@ -21,6 +21,7 @@
 #include "data/Database.h"
 #include "data/Graphics.h"
 #include "common.h"
+#include "tsl/robin_map.h"
 #include <openssl/evp.h>
 #include <iostream>
 #include <iomanip>
@@ -32,6 +33,12 @@
 
 extern BError* OUT_OF_RANGE;
 
+#define BSTRING_MAX_DEPTH 256  // deeper concatenations are flattened immediately, which balanced joins practically never reach
+#define BSTRING_ROPE_SIZE 64   // shorter concatenations are copied immediately, because that is cheaper than a rope
+
+static tsl::robin_map<std::string, BString*> internedStrings;
+static std::mutex internLock;
+
 inline std::string calculateHash(const std::string& input, const EVP_MD* (*hash_function)()) {
     EVP_MD_CTX* context = EVP_MD_CTX_new();
     bbassert(context, "OpenSSL error: Failed to create EVP_MD_CTX");
@@ -50,26 +57,95 @@ inline std::string calculateHash(const std::string& input, const EVP_MD* (*hash_
 }
 
 
-BString::BString(const std::string& val) : Data(STRING), contents(val) {}
-BString::BString() : Data(STRING), contents("") {}
-size_t BString::toHash() const {return std::hash<std::string>{}(contents);}
-std::string BString::toString(BMemory* memory){return contents;}
-std::string& BString::toString(){return contents;}
-BString::~BString() {}
+BString::BString(std::string val) : Data(STRING), contents(std::move(val)), hash(0), left(nullptr), right(nullptr), flat(true), size(contents.size()), depth(0), interned(false) {}
+BString::BString() : Data(STRING), contents(""), hash(0), left(nullptr), right(nullptr), flat(true), size(0), depth(0), interned(false) {}
+BString::BString(BString* left, BString* right) : Data(STRING), hash(0), left(left), right(right), flat(false), 
+    size(left->size+right->size), depth(std::max(left->depth, right->depth)+1), interned(false) {
+    left->addOwner();
+    right->addOwner();
+}
+BString* BString::intern(const std::string& val) {
+    std::lock_guard<std::mutex> lock(internLock);
+    auto it = internedStrings.find(val);
+    if(it!=internedStrings.end()) return it->second;
+    BString* ret = new BString(val);
+    ret->interned = true;
+    ret->toHash();
+    ret->addOwner();
+    ret->share(); // reachable from all threads through the table
+    internedStrings[val] = ret;
+    return ret;
+}
+
+BString::~BString() {
+    if(flat.load(std::memory_order_relaxed)) return;
+    left->removeFromOwner();
+    right->removeFromOwner();
+}
+
+void BString::appendTo(std::string& out) const {
+    OwnedLock lock(this, memoryLock);
+    if(flat.load(std::memory_order_relaxed)) out += contents;
+    else {
+        left->appendTo(out);
+        right->appendTo(out);
+    }
+}
+
+void BString::flatten() const {
+    if(flat.load(std::memory_order_acquire)) return;
+    OwnedLock lock(this, memoryLock);
+    if(flat.load(std::memory_order_relaxed)) return;
+    std::string result;
+    result.reserve(size);
+    left->appendTo(result);
+    right->appendTo(result);
+    contents = std::move(result);
+    left->removeFromOwner();
+    right->removeFromOwner();
+    left = nullptr;
+    right = nullptr;
+    flat.store(true, std::memory_order_release);
+}
+
+void BString::share() {
+    if(isShared()) return;
+    Data::share();
+    OwnedLock lock(this, memoryLock);
+    if(flat.load(std::memory_order_relaxed)) return;
+    left->share();
+    right->share();
+}
+
+size_t BString::toHash() const {
+    size_t ret = hash.load(std::memory_order_relaxed);
+    if(ret) return ret;
+    ret = std::hash<std::string>{}(toString());
+    hash.store(ret, std::memory_order_relaxed);
+    return ret;
+}
+std::string BString::toString(BMemory* memory){return toString();}
+const std::string& BString::toString() const {flatten(); return contents;}
 
 bool BString::isSame(const DataPtr& other) {
-    if (other.existsAndTypeEquals(STRING)) return toString() == static_cast<BString*>(other.get())->toString();
-    return false;
+    if (!other.existsAndTypeEquals(STRING)) return false;
+    BString* str = static_cast<BString*>(other.get());
+    if (str == this) return true;
+    if (interned && str->interned) return false;
+    size_t otherHash = str->hash.load(std::memory_order_relaxed);
+    size_t thisHash = hash.load(std::memory_order_relaxed);
+    if (thisHash && otherHash && thisHash!=otherHash) return false;
+    return toString() == str->toString();
 }
 
 Result BString::eq(BMemory* memory, const DataPtr& other) {
     bbassert(other.existsAndTypeEquals(STRING), "Strings can only be compared to strings and not " + other.torepr());
-    return RESMOVE(Result(toString() == static_cast<BString*>(other.get())->toString()));
+    return RESMOVE(Result(isSame(other)));
 }
 
 Result BString::neq(BMemory* memory, const DataPtr& other) {
     bbassert(other.existsAndTypeEquals(STRING), "Strings can only be compared to strings and not " + other.torepr());
-    return RESMOVE(Result(toString() != static_cast<BString*>(other.get())->toString()));
+    return RESMOVE(Result(!isSame(other)));
 }
 
 Result BString::lt(BMemory* memory, const DataPtr& other) {
@@ -315,6 +391,7 @@ std::string fromBase64(const std::string& base64_input) {
 
 
 Result BString::at(BMemory *memory, const DataPtr& other) {
+    flatten();
     if(other.isint()) {
         int64_t index = other.unsafe_toint();
         int64_t n = (int64_t)contents.size();
@@ -392,6 +469,7 @@ Result BString::at(BMemory *memory, const DataPtr& other) {
 }
 
 int64_t BString::toInt(BMemory *memory) {
+    flatten();
     char* endptr = nullptr;
     int64_t ret = std::strtol(contents.c_str(), &endptr, 10);
     if(endptr == contents.c_str() || *endptr != '\0') bberror("Failed to convert string to int");
@@ -399,6 +477,7 @@ int64_t BString::toInt(BMemory *memory) {
 }
 
 double BString::toFloat(BMemory *memory) {
+    flatten();
     char* endptr = nullptr;
     double ret = std::strtod(contents.c_str(), &endptr);
     if(endptr == contents.c_str() || *endptr != '\0') bberror("Failed to convert string to float");
@@ -406,12 +485,13 @@ double BString::toFloat(BMemory *memory) {
 }
 
 bool BString::toBool(BMemory *memory) {
+    flatten();
     if(contents=="true") return true;
     if(contents=="false") return false;
     bberror("Failed to convert string to bool");
 }
 
-Result BString::iter(BMemory *memory) {return RESMOVE(Result(new AccessIterator(this, contents.size())));}
+Result BString::iter(BMemory *memory) {return RESMOVE(Result(new AccessIterator(this, size)));}
 Result BString::add(BMemory *memory, const DataPtr& other) {
     if(!other.existsAndTypeEquals(STRING)) {
         if(other.existsAndTypeEquals(ERRORTYPE)) return RESMOVE(Result(new BString(toString(nullptr)+other->toString(nullptr))));
@@ -420,29 +500,66 @@ Result BString::add(BMemory *memory, const DataPtr& other) {
     }
 
     BString* otherString = static_cast<BString*>(other.get());
-    BString* ret = new BString(toString() + otherString->toString());
-    /*ret->size = size + otherString->size;
+    return RESMOVE(Result(concat(this, otherString)));
+}
 
-    int retDepth;
-    {
-        std::lock_guard<std::recursive_mutex> lock(otherString->memoryLock);
-        retDepth = otherString->depth;
+BString* BString::concat(BString* left, BString* right) {
+    if(left->size+right->size<BSTRING_ROPE_SIZE || std::max(left->depth, right->depth)>=BSTRING_MAX_DEPTH) {
+        std::string result;
+        result.reserve(left->size+right->size);
+        left->appendTo(result);
+        right->appendTo(result);
+        return new BString(std::move(result));
     }
-    {
-        std::lock_guard<std::recursive_mutex> lock(memoryLock);
-        if(depth<retDepth) depth = retDepth;
+    // like joins of AVL trees, the shallower part is joined into the inner side of the deeper one and rotations keep
+    // sibling depths within one, so that repeated appends or prepends only allocate the nodes along one path
+    if(left->depth>right->depth+1) {
+        OwnedLock lock(left, left->memoryLock);
+        if(!left->flat.load(std::memory_order_relaxed)) return balanced(left->left, concat(left->right, right));
     }
-    if(retDepth>512) {
-        ret->front = ret->toString() + otherString->toString();
+    else if(right->depth>left->depth+1) {
+        OwnedLock lock(right, right->memoryLock);
+        if(!right->flat.load(std::memory_order_relaxed)) return balanced(concat(left, right->left), right->right);
     }
-    else {
-        ret->depth = retDepth+1;
-        ret->concatenated.push_back(this);
-        ret->concatenated.push_back(otherString);
-        ret->addOwner();
-        otherString->addOwner();
-    }*/
-
-    return RESMOVE(Result(ret));
+    return new BString(left, right);
+}
+
+BString* BString::balanced(BString* left, BString* right) {
+    if(left->depth>right->depth+1) {
+        left->addOwner(); // may be a fresh join that the rotation discards
+        BString* ret = nullptr;
+        {
+            OwnedLock lock(left, left->memoryLock);
+            BString* inner = left->right;
+            if(left->flat.load(std::memory_order_relaxed)) ret = new BString(left, right);
+            else if(left->left->depth>=inner->depth) ret = new BString(left->left, new BString(inner, right));
+            else {
+                OwnedLock innerLock(inner, inner->memoryLock);
+                if(inner->flat.load(std::memory_order_relaxed)) ret = new BString(left->left, new BString(inner, right));
+                else ret = new BString(new BString(left->left, inner->left), new BString(inner->right, right));
+            }
+        }
+        left->removeFromOwner();
+        return ret;
+    }
+    if(right->depth>left->depth+1) {
+        right->addOwner();
+        BString* ret = nullptr;
+        {
+            OwnedLock lock(right, right->memoryLock);
+            BString* inner = right->left;
+            if(right->flat.load(std::memory_order_relaxed)) ret = new BString(left, right);
+            else if(right->right->depth>=inner->depth) ret = new BString(new BString(left, inner), right->right);
+            else {
+                OwnedLock innerLock(inner, inner->memoryLock);
+                if(inner->flat.load(std::memory_order_relaxed)) ret = new BString(new BString(left, inner), right->right);
+                else ret = new BString(new BString(left, inner->left), new BString(inner->right, right->right));
+            }
+        }
+        right->removeFromOwner();
+        return ret;
+    }
+    return new BString(left, right);
 }
-int64_t BString::len(BMemory *memory) {return contents.size();}
\ No newline at end of file
+
+int64_t BString::len(BMemory *memory) {return size;}
\ No newline at end of file
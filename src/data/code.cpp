@@ -26,7 +26,7 @@ extern std::vector<SymbolWorries> symbolUsage;
 extern std::mutex ownershipMutex;
 
 Code::Code(const std::vector<Command>* programAt, size_t startAt, size_t endAt, size_t premature_end)
-    : program(programAt), start(startAt), end(endAt), scheduleForParallelExecution(true), Data(CODE), jitable(nullptr), premature_end(premature_end) {}
+    : program(programAt), start(startAt), end(endAt), scheduleForParallelExecution(true), Data(CODE), jitable(nullptr), layout(nullptr), premature_end(premature_end) {}
 
 std::string Code::toString(BMemory* memory){
     if(jitable) return "code block in .bbvm file lines " + std::to_string(start) + " to " + std::to_string(end) + " with "+jitable->toString();
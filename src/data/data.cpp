@@ -16,6 +16,6 @@
 
 #include "data/Data.h"
 
-Data::Data(Datatype type) : type(type), referenceCounter(0) {}
+Data::Data(Datatype type) : type(type), referenceCounter(0), shared(false) {}
 bool Data::isSame(const DataPtr& other) {return other==this;}
 size_t Data::toHash() const {return (size_t)this;}
\ No newline at end of file
@@ -18,38 +18,54 @@
 #include "common.h"
 #include <iostream>
 #include <atomic>
+#include "interpreter/ThreadPool.h"
 
-int Future::max_threads = 0;
-std::atomic<int> Future::thread_count = 0;
 
-void Future::setMaxThreads(int maxThreads_) {max_threads = maxThreads_;}
-bool Future::acceptsThread() {return thread_count+1 < max_threads;}
+void Future::setMaxThreads(int maxThreads_) {threadPool.resize(maxThreads_-1);} // the thread calling the vm also counts
+bool Future::acceptsThread() {return threadPool.acceptsTask();}
 std::string Future::toString(BMemory* memory){return "future";}
-Future::Future() : result(new ThreadResult()), Data(FUTURE) {++thread_count;}
-Future::Future(ThreadResult* result_) : result((result_)), Data(FUTURE) {++thread_count;}
+Future::Future() : result(std::make_shared<ThreadResult>()), Data(FUTURE) {}
+Future::Future(std::shared_ptr<ThreadResult> result_) : result(std::move(result_)), Data(FUTURE) {}
 
 Future::~Future() {
+    result->wait();
+}
+
+void ThreadResult::start(unsigned int depth_, Code* code_, BMemory* newMemory, const Command* command_, DataPtr thisObj_) {
+    depth = depth_;
+    code = code_;
+    memory = newMemory;
+    command = command_;
+    thisObj = thisObj_;
+    state = PENDING;
+    threadPool.submit(shared_from_this());
+}
+
+bool ThreadResult::tryRun() {
+    int expected = PENDING;
+    if(!state.compare_exchange_strong(expected, RUNNING)) return false;
+    try {threadExecute(depth, code, memory, this, command, thisObj);}
+    catch (...) {value = Result(new BError("Failed to run thread"));}
     {
-        if (result->thread.joinable()) {
-            result->thread.join();
-            --thread_count;
-        }
+        std::lock_guard<std::mutex> lock(doneLock);
+        state = DONE;
     }
-    delete result;
+    doneCondition.notify_all();
+    return true;
 }
 
-Result Future::getResult() const {
-    try { 
-        if (result->thread.joinable()) {
-            result->thread.join();
-            --thread_count;
-        }
-    } 
-    catch (...) {
-        result->value = Result(new BError("Failed to join thread"));
-        --thread_count;
-        return RESMOVE(Result(result->value.get()));
+void ThreadResult::wait() {
+    // run the task in the current thread if no worker picked it up yet, otherwise help with other pending tasks
+    if(tryRun()) return;
+    while(state.load()!=DONE) {
+        if(threadPool.help()) continue;
+        std::unique_lock<std::mutex> lock(doneLock);
+        doneCondition.wait(lock, [this] {return state.load()==DONE;});
     }
+}
+
+Result Future::getResult() const {
+    result->wait();
     DataPtr ret = result->value.get();
     if(ret.existsAndTypeEquals(FUTURE)) return RESMOVE(static_cast<Future*>(ret.get())->getResult());
     return RESMOVE(Result(ret));
@@ -45,10 +45,10 @@ Graphics::Graphics(const std::string& title, int width, int height) : Data(GRAPH
     }
     color = {255, 255, 255, 255};
     
-    typeVariable = variableManager.getId("io::type");
-    keyVariable = variableManager.getId("io::key");
-    xVariable = variableManager.getId("io::x");
-    yVariable = variableManager.getId("io::y");
+    typeVariable = variableManager.ioType;
+    keyVariable = variableManager.ioKey;
+    xVariable = variableManager.ioX;
+    yVariable = variableManager.ioY;
 
     keyUpString = new BString("key::up");
     keyDownString = new BString("key::down");
@@ -291,6 +291,7 @@ Result Graphics::pop(BMemory* memory) {
             
             // Add the struct to signals
             signalStruct->addOwner();
+            if(signals->isShared()) signalStruct->share();
             signals->contents.push_back(signalStruct);
         } else if (event.type == SDL_MOUSEBUTTONDOWN || event.type == SDL_MOUSEBUTTONUP) {
             int x = event.button.x;
@@ -310,6 +311,7 @@ Result Graphics::pop(BMemory* memory) {
             signalStruct->set(xVariable, static_cast<double>(x));
             signalStruct->set(yVariable, static_cast<double>(y));
             signalStruct->addOwner();
+            if(signals->isShared()) signalStruct->share();
             signals->contents.push_back(signalStruct);
         } else if (event.type == SDL_MOUSEMOTION) {
             int x = event.motion.x;
@@ -320,6 +322,7 @@ Result Graphics::pop(BMemory* memory) {
             signalStruct->set(xVariable, static_cast<double>(x));
             signalStruct->set(yVariable, static_cast<double>(y));
             signalStruct->addOwner();
+            if(signals->isShared()) signalStruct->share();
             signals->contents.push_back(signalStruct);
         }
     }
@@ -17,6 +17,7 @@
 #include "data/BHashMap.h"
 #include "data/BString.h"
 #include "data/List.h"
+#include "data/Vector.h"
 #include "data/Iterator.h"
 #include "data/BError.h"
 #include "common.h"
@@ -30,27 +31,30 @@
 
 extern BError* OUT_OF_RANGE;
 
-MapIterator::MapIterator(BHashMap* map_): map(map_), elementIndex(-1) {
+void MapIterator::share() {
+    Data::share();
+    map->share();
+}
+
+MapIterator::MapIterator(BHashMap* map_): map(map_) {
     std::lock_guard<std::recursive_mutex> lock(map->memoryLock);
-    bucketIt = map->contents.begin();
+    map->addOwner();
+    it = map->contents.begin();
 }
+MapIterator::~MapIterator() {map->removeFromOwner();}
 
 Result MapIterator::next(BMemory* memory) {
     std::lock_guard<std::recursive_mutex> lock(map->memoryLock);
-    if (bucketIt == map->contents.end()) return Result(OUT_OF_RANGE);
-    elementIndex++;
-    while (bucketIt != map->contents.end() && elementIndex >= static_cast<int64_t>(bucketIt->second.size())) {
-        ++bucketIt;
-        elementIndex = 0;
-    }
-    if (bucketIt == map->contents.end()) return Result(OUT_OF_RANGE);
-    auto& kvPair = bucketIt->second[elementIndex];
+    if (it == map->contents.end()) return Result(OUT_OF_RANGE);
+    const DataPtr& key = it->first;
+    const DataPtr& value = it->second;
+    ++it;
 
     BList* item = new BList(2);
-    item->contents.push_back(kvPair.first);
-    item->contents.push_back(kvPair.second);
-    kvPair.first.existsAddOwner();
-    kvPair.second.existsAddOwner();
+    item->contents.push_back(key);
+    item->contents.push_back(value);
+    key.existsAddOwner();
+    value.existsAddOwner();
     return Result(item);
 }
 Result MapIterator::iter(BMemory* memory) {return RESMOVE(Result(this));}
@@ -59,9 +63,10 @@ Result MapIterator::iter(BMemory* memory) {return RESMOVE(Result(this));}
 BHashMap::BHashMap() : Data(MAP) {}
 BHashMap::~BHashMap() {
     std::lock_guard<std::recursive_mutex> lock(memoryLock);
-    for (auto& bucket : contents) for (auto& kvPair : bucket.second) {
-        kvPair.first.existsRemoveFromOwner();
-        kvPair.second.existsRemoveFromOwner();
+    for (auto it = contents.begin(); it != contents.end(); ++it) {
+        DataPtr key = it->first;
+        key.existsRemoveFromOwner();
+        it.value().existsRemoveFromOwner();
     }
     contents.clear();
 }
@@ -70,7 +75,7 @@ std::string BHashMap::toString(BMemory* memory) {
     std::lock_guard<std::recursive_mutex> lock(memoryLock);
     std::string result = "{";
     bool firstEntry = true;
-    for (const auto& bucket : contents) for (const auto& kvPair : bucket.second) {
+    for (const auto& kvPair : contents) {
         if (!firstEntry) result += ", ";
         result += (kvPair.first.exists()?kvPair.first->toString(memory):kvPair.first.torepr()) + ": " + (kvPair.second.exists()?kvPair.second->toString(memory):kvPair.second.torepr());
         firstEntry = false;
@@ -79,22 +84,35 @@ std::string BHashMap::toString(BMemory* memory) {
     return result;
 }
 
+void BHashMap::share() {
+    if(isShared()) return;
+    Data::share();
+    std::lock_guard<std::recursive_mutex> lock(memoryLock);
+    for(const auto& kvPair : contents) {
+        kvPair.first.existsShare();
+        kvPair.second.existsShare();
+    }
+}
+
 void BHashMap::fastUnsafePut(const DataPtr& from, const DataPtr& to) {
-    size_t keyHash = from.islit()?from.unsafe_toint():from->toHash();
-    auto& entryList = contents[keyHash];
-
-    for (auto& kvPair : entryList) if (kvPair.first->isSame(from)) {
-        DataPtr prevValue = kvPair.second;
-        kvPair.second = to;            
-        to.existsAddOwner();
-        prevValue.existsRemoveFromOwner();
+    if(isShared()) {
+        from.existsShare();
+        to.existsShare();
+    }
+    auto [it, inserted] = contents.try_emplace(from, to);
+    to.existsAddOwner();
+    if(inserted) {
+        from.existsAddOwner();
         return;
     }
+    DataPtr prevValue = it->second;
+    it.value() = to;
+    prevValue.existsRemoveFromOwner();
+}
 
-    // If not found, we add a new key-value pair
-    entryList.emplace_back(from, to);
-    to.existsAddOwner();
-    from.existsAddOwner();
+void BHashMap::reserve(size_t count) {
+    OwnedLock lock(this, memoryLock);
+    contents.reserve(count);
 }
 
 Result BHashMap::put(BMemory* memory, const DataPtr& from, const DataPtr& to) {
@@ -103,22 +121,10 @@ Result BHashMap::put(BMemory* memory, const DataPtr& from, const DataPtr& to) {
     if(from.existsAndTypeEquals(ERRORTYPE)) bberror(from->toString(nullptr));
     if(to.existsAndTypeEquals(ERRORTYPE)) bberror(from->toString(nullptr));
 
-    size_t keyHash = from.islit()?from.unsafe_toint():from->toHash();
-    std::lock_guard<std::recursive_mutex> lock(memoryLock);
-    auto& entryList = contents[keyHash];
-
-    for (auto& kvPair : entryList) if (kvPair.first.isSame(from)) {
-        DataPtr prevValue = kvPair.second;
-        kvPair.second = to;            
-        to.existsAddOwner();
-        prevValue.existsRemoveFromOwner();
-        return RESMOVE(Result(DataPtr::NULLP));
-    }
+    if(to.existsAndTypeEquals(VECTOR)) static_cast<Vector*>(to.get())->materialize();
 
-    // If not found, we add a new key-value pair
-    entryList.emplace_back(from, to);
-    to.existsAddOwner();
-    from.existsAddOwner();
+    OwnedLock lock(this, memoryLock);
+    fastUnsafePut(from, to);
     return RESMOVE(Result(DataPtr::NULLP));
 }
 
@@ -126,11 +132,9 @@ Result BHashMap::put(BMemory* memory, const DataPtr& from, const DataPtr& to) {
 Result BHashMap::at(BMemory* memory, const DataPtr& keyData) {
     if(keyData==DataPtr::NULLP) bberror("Cannot have a missing value as key");
     {
-        size_t keyHash = keyData.islit()?keyData.unsafe_toint():keyData->toHash();
-        std::lock_guard<std::recursive_mutex> lock(memoryLock);
-        auto it = contents.find(keyHash);
-        if (it != contents.end()) for (const auto& kvPair : it->second) if (kvPair.first->isSame(keyData)) 
-            return Result(kvPair.second);
+        OwnedLock lock(this, memoryLock);
+        auto it = contents.find(keyData);
+        if (it != contents.end()) return Result(it->second);
     }
     if(keyData.islit()) return RESMOVE(Result(OUT_OF_RANGE));
     Result iterResult = keyData->iter(memory);
@@ -148,16 +152,12 @@ Result BHashMap::at(BMemory* memory, const DataPtr& keyData) {
                 Result nextKeyResult = iter->next(memory);
                 DataPtr nextKey = nextKeyResult.get();
                 if (nextKey==OUT_OF_RANGE) break;
-                size_t keyHash = nextKey.islit()?nextKey.unsafe_toint():nextKey->toHash();
-                auto it = contents.find(keyHash);
-                bool keyFound = false;
-                if (it != contents.end()) for (const auto& kvPair : it->second) if (kvPair.first->isSame(nextKey)) {
-                    resultList->contents.push_back(kvPair.second);
-                    kvPair.second.existsAddOwner();
-                    keyFound = true;
-                    break;
+                auto it = contents.find(nextKey);
+                if (it != contents.end()) {
+                    resultList->contents.push_back(it->second);
+                    it->second.existsAddOwner();
                 }
-                if (!keyFound) {
+                else {
                     allKeysFound = false;
                     break;
                 }
@@ -178,9 +178,10 @@ Result BHashMap::at(BMemory* memory, const DataPtr& keyData) {
 }
 void BHashMap::clear(BMemory* memory) {
     std::lock_guard<std::recursive_mutex> lock(memoryLock);
-    for (auto& bucket : contents) for (auto& kvPair : bucket.second) {
-        kvPair.first.existsRemoveFromOwner();
-        kvPair.second.existsRemoveFromOwner();
+    for (auto it = contents.begin(); it != contents.end(); ++it) {
+        DataPtr key = it->first;
+        key.existsRemoveFromOwner();
+        it.value().existsRemoveFromOwner();
     }
     contents.clear();
 }
@@ -192,10 +193,8 @@ Result BHashMap::move(BMemory* memory) {
     return RESMOVE(Result(ret));
 }
 int64_t BHashMap::len(BMemory* memory) {
-    std::lock_guard<std::recursive_mutex> lock(memoryLock);
-    int64_t count = 0;
-    for (const auto& bucket : contents) count += bucket.second.size();
-    return count;
+    OwnedLock lock(this, memoryLock);
+    return contents.size();
 }
 Result BHashMap::iter(BMemory* memory) {
     std::lock_guard<std::recursive_mutex> lock(memoryLock);
@@ -25,8 +25,8 @@ extern BError* OUT_OF_RANGE;
 Iterator::Iterator() : Data(ITERATOR) {}
 std::string Iterator::toString(BMemory* memory) {return "iterator";}
 
-AccessIterator::AccessIterator(DataPtr object_, int64_t size) : object(object_.get()), pos(-1), size(size), Iterator() {}
-AccessIterator::~AccessIterator() {}
+AccessIterator::AccessIterator(DataPtr object_, int64_t size) : object(object_.get()), pos(-1), size(size), Iterator() {object->addOwner();}
+AccessIterator::~AccessIterator() {object->removeFromOwner();}
 Result AccessIterator::next(BMemory* memory) {
     std::lock_guard<std::recursive_mutex> lock(memoryLock);
     pos += 1; 
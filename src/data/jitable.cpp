@@ -27,6 +27,12 @@
 #include <iostream> // Required for std::cerr and std::cout
 #include <cstdlib>  // Required for system()
 #include <cassert>  // Required for assert
+#include <cstdio>
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <filesystem>
 
 #ifdef _WIN32
 #include <windows.h> // Required for LoadLibrary, GetProcAddress, and FreeLibrary
@@ -36,7 +42,7 @@
 
 extern BError* OUT_OF_RANGE;
 extern std::recursive_mutex compileMutex;
-bool allowJit = false;
+bool allowJit = true;
 
 
 std::string int2type(int type) {
@@ -126,37 +132,144 @@ std::wstring toWideString(const std::string& str) {
 }
 #endif
 
+#ifdef _WIN32
+#define JIT_FLAGS "-O2 -fwrapv -shared"
+#define JIT_EXTENSION ".dll"
+#define JIT_NULL_DEVICE "nul"
+#define JIT_TARGET_QUERY "gcc -dumpfullversion -dumpversion 2>nul"
+#define popen _popen
+#define pclose _pclose
+#else
+#define JIT_FLAGS "-O2 -march=native -fwrapv -shared -fPIC"
+#define JIT_EXTENSION ".so"
+#define JIT_NULL_DEVICE "/dev/null"
+// -march=native is resolved to the actual cpu and its enabled extensions, so that caches shared across machines do not mix targets
+#define JIT_TARGET_QUERY "gcc -dumpfullversion -dumpversion 2>/dev/null && gcc -march=native -Q --help=target 2>/dev/null"
+#endif
+#define JIT_CACHE_BYTES (64*1024*1024)
+
+// Compiled shared objects are also cached on disk across runs. Entries are content-addressed by a hash of the
+// generated C source, the compiler version and resolved target, and the compilation flags, and the source is stored alongside
+// each entry to rule out hash collisions. The cache directory is BLOMBLY_JIT_CACHE if set, or the user's cache directory.
+std::string jitCompilerTarget() {
+    static std::string target = [] {
+        std::string ret;
+        FILE* pipe = popen(JIT_TARGET_QUERY, "r");
+        if(!pipe) return ret;
+        char buffer[128];
+        while(fgets(buffer, sizeof(buffer), pipe)) ret += buffer;
+        pclose(pipe);
+        return ret;
+    }();
+    return target;
+}
+
+std::filesystem::path jitCacheDirectory() {
+    static std::filesystem::path directory = [] {
+        std::filesystem::path ret;
+        if(const char* custom = std::getenv("BLOMBLY_JIT_CACHE")) ret = custom;
+        #ifdef _WIN32
+        else if(const char* local = std::getenv("LOCALAPPDATA")) ret = std::filesystem::path(local) / "blombly" / "jit";
+        #else
+        else if(const char* xdg = std::getenv("XDG_CACHE_HOME")) ret = std::filesystem::path(xdg) / "blombly" / "jit";
+        else if(const char* home = std::getenv("HOME")) ret = std::filesystem::path(home) / ".cache" / "blombly" / "jit";
+        #endif
+        else return ret;
+        std::error_code ec;
+        std::filesystem::create_directories(ret, ec);
+        if(ec) ret.clear();
+        return ret;
+    }();
+    return directory;
+}
+
+std::string jitCacheKey(const std::string& code) {
+    // 64-bit FNV-1a, which (unlike std::hash) is stable across builds
+    uint64_t hash = 14695981039346656037ULL;
+    for(unsigned char c : code+'\0'+jitCompilerTarget()+'\0'+JIT_FLAGS) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(hash));
+    return buffer;
+}
+
+bool jitCacheMatches(const std::filesystem::path& source, const std::string& code) {
+    std::ifstream file(source, std::ios::binary);
+    if(!file) return false;
+    std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return contents==code;
+}
+
+// Evicts least recently used entries (loading an entry refreshes its modification time) until the cache fits its budget.
+void jitCacheEvict(const std::filesystem::path& directory) {
+    std::error_code ec;
+    std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> entries;
+    uintmax_t total = 0;
+    for(const auto& entry : std::filesystem::directory_iterator(directory, ec)) {
+        if(entry.path().extension()!=JIT_EXTENSION) continue;
+        uintmax_t size = entry.file_size(ec);
+        if(ec) continue;
+        total += size;
+        entries.emplace_back(entry.last_write_time(ec), entry.path());
+    }
+    if(total<=JIT_CACHE_BYTES) return;
+    std::sort(entries.begin(), entries.end());
+    for(const auto& [time, path] : entries) {
+        if(total<=JIT_CACHE_BYTES) break;
+        uintmax_t size = std::filesystem::file_size(path, ec);
+        if(!ec) total -= size;
+        std::filesystem::remove(path, ec);
+        std::filesystem::path source = path;
+        std::filesystem::remove(source.replace_extension(".c"), ec);
+    }
+}
+
 class Compile {
     void *handle;
     void *func;
 public:
     Compile(const std::string& code, const std::string& name) {
-        std::string filename = "temp" + std::to_string(compilationCounter) + ".jit.bb";
-        std::ofstream(filename + ".c") << code;
+        std::error_code ec;
+        std::filesystem::path directory = jitCacheDirectory();
+        bool cached = !directory.empty();
+        std::string filename;
+        if(cached) {
+            filename = (directory / jitCacheKey(code)).string();
+            if(std::filesystem::exists(filename + JIT_EXTENSION, ec) && jitCacheMatches(filename + ".c", code)) 
+                std::filesystem::last_write_time(filename + JIT_EXTENSION, std::filesystem::file_time_type::clock::now(), ec);
+            else {
+                // compile under a unique name and rename, so that concurrent processes never load partially written files
+                std::string temporary = filename + "." + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + "_" + std::to_string(compilationCounter++);
+                cached = compileLibrary(code, temporary);
+                if(cached) {
+                    std::ofstream(filename + ".c", std::ios::binary) << code;
+                    std::filesystem::rename(temporary + JIT_EXTENSION, filename + JIT_EXTENSION, ec);
+                    cached = !ec;
+                    if(cached) jitCacheEvict(directory);
+                    else std::filesystem::remove(temporary + JIT_EXTENSION, ec);
+                }
+            }
+        }
+        if(!cached) {
+            // temporary files go to the system's temporary directory with names that differ across processes
+            filename = (std::filesystem::temp_directory_path() / ("blombly" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + "_" + std::to_string(compilationCounter++) + ".jit.bb")).string();
+            bbassert(compileLibrary(code, filename), "Compilation failed");
+        }
 
-        // Adjust compiler and extensions based on platform
+        // Adjust loading based on platform
         #ifdef _WIN32
-        int ret = system(("gcc -O2 -shared -o ./" + filename + ".dll ./" + filename + ".c").c_str());
-        bbassert(ret == 0, "Compilation failed");
-
-        std::wstring wideFilename = toWideString("./" + filename + ".dll");
+        std::wstring wideFilename = toWideString(filename + JIT_EXTENSION);
         handle = LoadLibraryW(wideFilename.c_str());
+        if(!cached) std::remove((filename + JIT_EXTENSION).c_str());
         bbassert(handle != nullptr, "Failed to load DLL");
         #else
-        int ret = system(("gcc -O2 -march=native -shared -fPIC ./" + filename + ".c -o ./" + filename + ".so").c_str());
-        bbassert(ret == 0, "Compilation failed");
-        handle = dlopen(("./" + filename + ".so").c_str(), RTLD_LAZY);
+        handle = dlopen((filename + JIT_EXTENSION).c_str(), RTLD_LAZY);
+        if(!cached) std::remove((filename + JIT_EXTENSION).c_str());
         bbassert(handle != nullptr, dlerror());
         #endif
 
-        // Cleanup temporary files
-        #ifdef _WIN32
-        bbassert(std::remove(("./" + filename + ".dll").c_str()) == 0, "Compilation was unable to remove a temporary file");
-        #else
-        bbassert(std::remove(("./" + filename + ".so").c_str()) == 0, "Compilation was unable to remove a temporary file");
-        #endif
-        bbassert(std::remove(("./" + filename + ".c").c_str()) == 0, "Compilation was unable to remove a temporary file");
-
         // Resolve symbol
         #ifdef _WIN32
         func = reinterpret_cast<void*>(GetProcAddress(static_cast<HMODULE>(handle), name.c_str()));
@@ -167,6 +280,17 @@ public:
         #endif
     }
 
+    static bool compileLibrary(const std::string& code, const std::string& filename) {
+        std::ofstream(filename + ".c", std::ios::binary) << code;
+        #ifdef _WIN32
+        int ret = system(("gcc " JIT_FLAGS " -o \"" + filename + JIT_EXTENSION "\" \"" + filename + ".c\" 2>" JIT_NULL_DEVICE).c_str());
+        #else
+        int ret = system(("gcc " JIT_FLAGS " \"" + filename + ".c\" -o \"" + filename + JIT_EXTENSION "\" -lm 2>" JIT_NULL_DEVICE).c_str());
+        #endif
+        std::remove((filename + ".c").c_str());
+        return ret == 0;
+    }
+
     ~Compile() {
         #ifdef _WIN32
         FreeLibrary(static_cast<HMODULE>(handle));
@@ -178,91 +302,375 @@ public:
     void* get() { return func; }
 };
 
-class JitCode : public Jitable {
-private:
-    Compile compile;
-    const std::vector<Command>* program;
-    int start;
-    int preparationEnd;
-    std::unordered_map<int, int> arguments;
-    std::vector<int> argumentOrder;
-    size_t expected_size;
-    int returnType;
+// Loaded shared objects are kept for the lifetime of the process and keyed by their C source,
+// so that identical blocks (e.g., the same function body loaded by several code objects) invoke gcc only once.
+std::unordered_map<std::string, std::unique_ptr<Compile>> compiledSources;
+
+void* compileNative(const std::string& source) {
+    auto it = compiledSources.find(source);
+    if(it!=compiledSources.end()) return it->second->get();
+    try {
+        auto compiled = std::make_unique<Compile>(source, "bbjit");
+        void* func = compiled->get();
+        compiledSources[source] = std::move(compiled);
+        return func;
+    }
+    catch(const BBError& e) {
+        // a missing or failing compiler disables the native tier but never the interpreter
+        allowJit = false;
+        return nullptr;
+    }
+}
+
+
+#define JIT_HOT_CALLS 1000
+#define JIT_HOT_ITERATIONS 1000
+#define JIT_MAX_SLOTS 64
+#define JIT_NONE 0
+#define JIT_INT 1
+#define JIT_FLOAT 2
+#define JIT_BOOL 3
+typedef std::unordered_map<int, char> NativeTypes;
+
+inline char nativeType(const DataPtr& value) {
+    if(value.isint()) return JIT_INT;
+    if(value.isfloat()) return JIT_FLOAT;
+    if(value.isbool()) return JIT_BOOL;
+    return JIT_NONE;
+}
+
+inline DataPtr fromNative(int64_t bits, char type) {
+    if(type==JIT_FLOAT) return DataPtr(std::bit_cast<double>(bits));
+    if(type==JIT_BOOL) return DataPtr(static_cast<bool>(bits));
+    return DataPtr(bits);
+}
+
+std::string nativeVar(int symbol, char type) {
+    if(type==JIT_FLOAT) return "f"+std::to_string(symbol);
+    if(type==JIT_BOOL) return "b"+std::to_string(symbol);
+    return "i"+std::to_string(symbol);
+}
+
+std::string nativeBits(int64_t bits) {
+    char buffer[64];
+    std::snprintf(buffer, sizeof(buffer), "((int64_t)0x%016llxULL)", static_cast<unsigned long long>(bits));
+    return buffer;
+}
+
+// Commands are copied when analysing blocks, because loading may later rewrite them into superinstructions.
+struct NativeCommand {
+    OperationType operation;
+    int args[3];
+    int argc;
+    DataPtr value;
+};
+
+// Analysis of a block whose commands all operate on int, float, and bool values.
+// Types are not known beforehand: they are inferred from the tags of the values found in memory once the block becomes hot.
+class NativeSegment {
 public:
-    virtual std::string toString() {return "JIT: used gcc to compile away everything after line "+std::to_string(preparationEnd);}
-
-    explicit JitCode(const std::string& code, const std::string& func, const std::vector<Command>* program, int start, int preparationEnd, 
-                    std::unordered_map<int, int> arguments, std::vector<int> argumentOrder, int returnType): 
-        compile(code, func), program(program), start(start), preparationEnd(preparationEnd), arguments(arguments), argumentOrder(argumentOrder), returnType(returnType) {
-            expected_size = 0;
-            for (int symbol : argumentOrder) {
-                int type = arguments[symbol];
-                if(type==TOBB_BOOL) expected_size += sizeof(bool);
-                else if(type==TOBB_FLOAT) expected_size += sizeof(double);
-                else if(type==TOBB_INT)  expected_size += sizeof(int64_t);
-                else bberror("Internal error: some jit functionality has not been implemented yet");
+    std::vector<NativeCommand> commands;
+    std::vector<int> reads;  // symbols read before being assigned within the block
+    std::vector<int> writes; // symbols assigned within the block
+    int resultSymbol;
+    bool eligible;
+
+    NativeSegment(const std::vector<Command>* program, int start, int end): resultSymbol(variableManager.noneId), eligible(start<end) {
+        std::unordered_set<int> assigned;
+        for(int i=start;i<end && eligible;++i) {
+            const Command& command = program->at(i);
+            int expectedArgs;
+            switch(command.operation) {
+                case BUILTIN: expectedArgs = 1; eligible = nativeType(command.value)!=JIT_NONE; break;
+                case IS: case NOT: case LOG: case TOBB_INT: case TOBB_FLOAT: case TOBB_BOOL: expectedArgs = 2; break;
+                case ADD: case SUB: case MUL: case DIV: case MOD: case POW: 
+                case LT: case LE: case GT: case GE: case EQ: case NEQ: case AND: case OR: expectedArgs = 3; break;
+                default: expectedArgs = 0; eligible = false;
             }
-        }
-    virtual bool run(BMemory* memory, DataPtr& returnValue, bool &returnSignal, bool forceStayInThread) override {
-        return false;
-        // preample
-        /*BuiltinArgs args;
-        DataPtr value = nullptr;
-        int i = start;
-        try {
-            for (; i <= preparationEnd; ++i) {
-                handleCommand(program, i, memory, returnSignal, args, returnValue, forceStayInThread);
-                if (returnSignal) return true;
+            if(!eligible || command.args.size()!=expectedArgs) {eligible = false; break;}
+            for(int j=1;j<expectedArgs;++j) {
+                int symbol = command.args[j];
+                if(symbol==variableManager.noneId) {eligible = false; break;}
+                if(assigned.find(symbol)==assigned.end() && std::find(reads.begin(), reads.end(), symbol)==reads.end()) reads.push_back(symbol);
             }
-        } 
-        catch (const BBError& e) {
-            handleExecutionError(program, i, e);
+            int symbol = command.args[0];
+            if(symbol!=variableManager.noneId && assigned.insert(symbol).second) writes.push_back(symbol);
+            resultSymbol = symbol;
+            NativeCommand copied = {command.operation, {}, expectedArgs, command.value};
+            for(int j=0;j<expectedArgs;++j) copied.args[j] = command.args[j];
+            commands.push_back(copied);
         }
-        
-        // Transfer arguments to the JIT-compiled function
-        std::vector<char> argBuffer(expected_size);
-        char* argPtr = argBuffer.data();
-
-        for (int symbol : argumentOrder) {
-            int type = arguments[symbol];
-            DataPtr data = memory->get(symbol);
-            if (type == TOBB_BOOL) {
-                bbassert(data->getType()==BB_BOOL, "Internal JIT error: Preparation failed to create a bool");
-                std::memcpy(argPtr, &static_cast<Boolean*>(data.get())->value, sizeof(bool));
-                argPtr += sizeof(bool);
-            } else if (type == TOBB_FLOAT) {
-                bbassert(data->getType()==BB_FLOAT, "Internal JIT error: Preparation failed to create a float");
-                std::memcpy(argPtr, &static_cast<BFloat*>(data.get())->value, sizeof(double));
-                argPtr += sizeof(double);
-            } else if (type == TOBB_INT) {
-                bbassert(data->getType()==BB_INT, "Internal JIT error: Preparation failed to create an integer");
-                std::memcpy(argPtr, &static_cast<Integer*>(data.get())->value, sizeof(int64_t));
-                argPtr += sizeof(int64_t);
-            } else {
-                bberror("Internal JIT error: Unhandled argument type during argument transfer.");
+        if(reads.size()+writes.size()+2>JIT_MAX_SLOTS) eligible = false;
+    }
+
+    // Infers the type of every assignment from the types of its operands and appends the equivalent C statements.
+    // Returns false if some operation has no native counterpart for the given types.
+    bool emit(NativeTypes& types, std::string& code) const {
+        for(const NativeCommand& command : commands) {
+            char a = JIT_NONE;
+            char b = JIT_NONE;
+            std::string x, y;
+            if(command.argc>1) {
+                auto it = types.find(command.args[1]);
+                if(it==types.end()) return false;
+                a = it->second;
+                x = nativeVar(command.args[1], a);
+            }
+            if(command.argc>2) {
+                auto it = types.find(command.args[2]);
+                if(it==types.end()) return false;
+                b = it->second;
+                y = nativeVar(command.args[2], b);
+            }
+            bool numeric = (a==JIT_INT || a==JIT_FLOAT) && (b==JIT_INT || b==JIT_FLOAT);
+            char type;
+            std::string expr;
+            switch(command.operation) {
+                case BUILTIN: 
+                    type = nativeType(command.value); 
+                    expr = type==JIT_FLOAT?"bbf("+nativeBits(command.value.unsafe_toint())+")":nativeBits(command.value.unsafe_toint()); 
+                    break;
+                case IS: type = a; expr = x; break;
+                case NOT: if(a!=JIT_BOOL) return false; type = JIT_BOOL; expr = "!"+x; break;
+                case AND: if(a!=JIT_BOOL || b!=JIT_BOOL) return false; type = JIT_BOOL; expr = "("+x+" && "+y+")"; break;
+                case OR: if(a!=JIT_BOOL || b!=JIT_BOOL) return false; type = JIT_BOOL; expr = "("+x+" || "+y+")"; break;
+                case ADD: if(!numeric) return false; type = a==JIT_INT && b==JIT_INT?JIT_INT:JIT_FLOAT; expr = "("+x+" + "+y+")"; break;
+                case SUB: if(!numeric) return false; type = a==JIT_INT && b==JIT_INT?JIT_INT:JIT_FLOAT; expr = "("+x+" - "+y+")"; break;
+                case MUL: if(!numeric) return false; type = a==JIT_INT && b==JIT_INT?JIT_INT:JIT_FLOAT; expr = "("+x+" * "+y+")"; break;
+                case DIV: if(!numeric) return false; type = JIT_FLOAT; expr = "((double)"+x+" / "+y+")"; break;
+                case MOD: if(a!=JIT_INT || b!=JIT_INT) return false; type = JIT_INT; expr = "("+x+" % "+y+")"; break;
+                case POW: if(!numeric) return false; type = JIT_FLOAT; expr = "pow((double)"+x+", (double)"+y+")"; break;
+                case LOG: if(a!=JIT_INT && a!=JIT_FLOAT) return false; type = JIT_FLOAT; expr = "log((double)"+x+")"; break;
+                case LT: if(!numeric) return false; type = JIT_BOOL; expr = "("+x+" < "+y+")"; break;
+                case LE: if(!numeric) return false; type = JIT_BOOL; expr = "("+x+" <= "+y+")"; break;
+                case GT: if(!numeric) return false; type = JIT_BOOL; expr = "("+x+" > "+y+")"; break;
+                case GE: if(!numeric) return false; type = JIT_BOOL; expr = "("+x+" >= "+y+")"; break;
+                case EQ: if(!numeric && (a!=JIT_BOOL || b!=JIT_BOOL)) return false; type = JIT_BOOL; expr = "("+x+" == "+y+")"; break;
+                case NEQ: if(!numeric && (a!=JIT_BOOL || b!=JIT_BOOL)) return false; type = JIT_BOOL; expr = "("+x+" != "+y+")"; break;
+                case TOBB_INT: type = JIT_INT; expr = "(int64_t)"+x; break;
+                case TOBB_FLOAT: type = JIT_FLOAT; expr = "(double)"+x; break;
+                case TOBB_BOOL: type = JIT_BOOL; expr = "("+x+" != 0)"; break;
+                default: return false;
             }
+            types[command.args[0]] = type;
+            code += "  "+nativeVar(command.args[0], type)+" = "+expr+";\n";
         }
+        return true;
+    }
+};
 
-        // Call the function
-        // Based on the returned type, set what is being returned
-        returnSignal = true;
-        if (returnType == TOBB_INT) {
-            int64_t value = reinterpret_cast<int64_t (*)(void*)>(compile.get())(argBuffer.data());
-            returnValue = new Integer(value);
-        } else if (returnType == TOBB_FLOAT) {
-            double value = reinterpret_cast<double (*)(void*)>(compile.get())(argBuffer.data());
-            returnValue = new BFloat(value);
-        } else if (returnType == TOBB_BOOL) {
-            bool value = reinterpret_cast<bool (*)(void*)>(compile.get())(argBuffer.data());
-            returnValue = value?Boolean::valueTrue:Boolean::valueFalse;
-        } else {
-            bberror("Unsupported return type from JIT function.");
+// A compiled specialization of a block (or of a whole loop) for the input types observed when it became hot.
+// Values are exchanged with native code through an array of 64-bit slots, one per symbol.
+struct NativeSpecialization {
+    void* func;
+    std::vector<int> symbols;
+    std::vector<std::pair<int, char>> inputs;      // slots guarded and loaded before running
+    std::vector<std::pair<int, char>> outputs;     // slots written back after running
+    std::vector<std::pair<int, char>> loopOutputs; // slots written back only if the loop body ran at least once
+    int resultSlot;
+    char resultType;
+
+    int slot(int symbol) {
+        for(size_t i=0;i<symbols.size();++i) if(symbols[i]==symbol) return i;
+        symbols.push_back(symbol);
+        return symbols.size()-1;
+    }
+
+    std::string prologue(const std::string& returnType) {
+        std::string code = "#include <stdint.h>\n#include <string.h>\n#include <math.h>\n"
+                           "#ifdef _WIN32\n#define BBEXPORT __declspec(dllexport)\n#else\n#define BBEXPORT\n#endif\n"
+                           "static inline double bbf(int64_t v) {double d; memcpy(&d, &v, sizeof(d)); return d;}\n"
+                           "static inline int64_t bbi(double d) {int64_t v; memcpy(&v, &d, sizeof(v)); return v;}\n"
+                           "BBEXPORT "+returnType+" bbjit(int64_t* s) {\n";
+        for(int symbol : symbols) code += "  int64_t i"+std::to_string(symbol)+" = 0; double f"+std::to_string(symbol)+" = 0; int64_t b"+std::to_string(symbol)+" = 0;\n";
+        for(const auto& [slot, type] : inputs) 
+            code += "  "+nativeVar(symbols[slot], type)+" = "+(type==JIT_FLOAT?"bbf(s["+std::to_string(slot)+"])":"s["+std::to_string(slot)+"]")+";\n";
+        return code;
+    }
+
+    std::string store(const std::vector<std::pair<int, char>>& slots) {
+        std::string code;
+        for(const auto& [slot, type] : slots) 
+            code += "  s["+std::to_string(slot)+"] = "+(type==JIT_FLOAT?"bbi("+nativeVar(symbols[slot], type)+")":nativeVar(symbols[slot], type))+";\n";
+        return code;
+    }
+
+    bool load(BMemory* memory, int64_t* slots) const {
+        for(const auto& [slot, type] : inputs) {
+            const DataPtr& value = memory->getOrNull(symbols[slot], true);
+            if(nativeType(value)!=type) return false;
+            slots[slot] = value.unsafe_toint();
         }
-        
-        // close defer statements
-        if(returnSignal)
-            memory->runFinally();
-        return true;*/
+        // leave finals, futures, and unhandled errors to the interpreter's checks
+        for(const auto& [slot, type] : outputs) if(!canOverwrite(memory, symbols[slot])) return false;
+        for(const auto& [slot, type] : loopOutputs) if(!canOverwrite(memory, symbols[slot])) return false;
+        return true;
+    }
+
+    static bool canOverwrite(BMemory* memory, int symbol) {
+        const DataPtr& prev = memory->getOrNullShallow(symbol);
+        return !prev.isA() && !prev.existsAndTypeEquals(FUTURE) && !prev.existsAndTypeEquals(ERRORTYPE);
+    }
+
+    void writeBack(BMemory* memory, const int64_t* slots, const std::vector<std::pair<int, char>>& written) const {
+        for(const auto& [slot, type] : written) memory->unsafeSetLiteral(symbols[slot], fromNative(slots[slot], type));
+    }
+};
+
+typedef void (*NativeBlock)(int64_t*);
+typedef int64_t (*NativeLoop)(int64_t*);
+
+// Tiered execution of numeric blocks: the interpreter runs them until they have been called JIT_HOT_CALLS times 
+// (or, as loop bodies, have completed JIT_HOT_ITERATIONS iterations), after which they are specialized on the 
+// types currently in memory and compiled. Type guards fall back to the interpreter whenever specializations do not apply.
+class NativeJitable : public Jitable {
+private:
+    NativeSegment segment;
+    std::atomic<int> calls;
+    std::atomic<int> iterations;
+    std::atomic<NativeSpecialization*> native;
+    std::atomic<NativeSpecialization*> nativeLoop;
+    std::atomic<bool> disabled;
+    std::atomic<bool> loopDisabled;
+    const NativeJitable* loopCondition;
+
+    NativeSpecialization* specialize(BMemory* memory) {
+        std::lock_guard<std::recursive_mutex> lock(compileMutex);
+        if(native.load(std::memory_order_acquire) || disabled.load(std::memory_order_relaxed)) return native.load(std::memory_order_acquire);
+        disabled.store(true, std::memory_order_relaxed); // only one attempt
+        if(!allowJit) return nullptr;
+        auto spec = std::make_unique<NativeSpecialization>();
+        NativeTypes types;
+        for(int symbol : segment.reads) {
+            char type = nativeType(memory->getOrNull(symbol, true));
+            if(type==JIT_NONE) return nullptr;
+            types[symbol] = type;
+            spec->inputs.emplace_back(spec->slot(symbol), type);
+        }
+        std::string body;
+        if(!segment.emit(types, body)) return nullptr;
+        for(int symbol : segment.writes) spec->outputs.emplace_back(spec->slot(symbol), types[symbol]);
+        spec->slot(variableManager.noneId); // discarded values still need a variable
+        spec->resultSlot = spec->slot(segment.resultSymbol);
+        spec->resultType = types[segment.resultSymbol];
+        std::string code = spec->prologue("void") + body + spec->store(spec->outputs) + spec->store({{spec->resultSlot, spec->resultType}}) + "}\n";
+        spec->func = compileNative(code);
+        if(!spec->func) return nullptr;
+        native.store(spec.release(), std::memory_order_release);
+        return native.load(std::memory_order_acquire);
+    }
+
+    NativeSpecialization* specializeLoop(BMemory* memory, const NativeJitable* condition) {
+        std::lock_guard<std::recursive_mutex> lock(compileMutex);
+        if(nativeLoop.load(std::memory_order_acquire) || loopDisabled.load(std::memory_order_relaxed)) return nativeLoop.load(std::memory_order_acquire);
+        loopDisabled.store(true, std::memory_order_relaxed); // only one attempt
+        if(!allowJit || !condition->segment.eligible || condition->segment.resultSymbol==variableManager.noneId) return nullptr;
+        if(condition->segment.commands.back().operation==IS) return nullptr;
+        auto spec = std::make_unique<NativeSpecialization>();
+
+        // loop-carried values are read at the loop head
+        NativeTypes head;
+        std::vector<int> reads = condition->segment.reads;
+        for(int symbol : segment.reads) 
+            if(std::find(condition->segment.writes.begin(), condition->segment.writes.end(), symbol)==condition->segment.writes.end() 
+                && std::find(reads.begin(), reads.end(), symbol)==reads.end()) reads.push_back(symbol);
+        for(int symbol : reads) {
+            char type = nativeType(memory->getOrNull(symbol, true));
+            if(type==JIT_NONE) return nullptr;
+            head[symbol] = type;
+            spec->inputs.emplace_back(spec->slot(symbol), type);
+        }
+
+        // the types after each iteration should be the same as the ones at the loop head
+        NativeTypes types = head;
+        std::string conditionCode, bodyCode, unused;
+        if(!condition->segment.emit(types, conditionCode)) return nullptr;
+        if(types[condition->segment.resultSymbol]!=JIT_BOOL) return nullptr;
+        if(!segment.emit(types, bodyCode)) return nullptr;
+        for(const auto& [symbol, type] : head) if(types[symbol]!=type) return nullptr;
+        NativeTypes afterCondition = types;
+        if(!condition->segment.emit(types, unused)) return nullptr;
+        for(int symbol : condition->segment.writes) if(types[symbol]!=afterCondition[symbol]) return nullptr;
+
+        for(int symbol : condition->segment.writes) spec->outputs.emplace_back(spec->slot(symbol), types[symbol]);
+        for(int symbol : segment.writes) 
+            if(std::find(condition->segment.writes.begin(), condition->segment.writes.end(), symbol)==condition->segment.writes.end()) 
+                spec->loopOutputs.emplace_back(spec->slot(symbol), types[symbol]);
+        for(int symbol : segment.reads) spec->slot(symbol);
+        spec->slot(variableManager.noneId); // discarded values still need a variable
+        spec->resultSlot = -1;
+        spec->resultType = JIT_NONE;
+        std::string code = spec->prologue("int64_t") 
+            + "  int64_t n = 0;\n  for(;;) {\n" + conditionCode 
+            + "  if(!"+nativeVar(condition->segment.resultSymbol, JIT_BOOL)+") break;\n" + bodyCode + "  ++n;\n  }\n"
+            + spec->store(spec->outputs) + spec->store(spec->loopOutputs) + "  return n;\n}\n";
+        spec->func = compileNative(code);
+        if(!spec->func) return nullptr;
+        loopCondition = condition;
+        nativeLoop.store(spec.release(), std::memory_order_release);
+        return nativeLoop.load(std::memory_order_acquire);
+    }
+
+public:
+    explicit NativeJitable(NativeSegment segment): segment(std::move(segment)), calls(0), iterations(0), native(nullptr), nativeLoop(nullptr), 
+        disabled(false), loopDisabled(false), loopCondition(nullptr) {}
+
+    bool runNative(BMemory* memory, int64_t* slots) {
+        NativeSpecialization* spec = native.load(std::memory_order_acquire);
+        if(!spec) {
+            if(disabled.load(std::memory_order_relaxed) || calls.fetch_add(1, std::memory_order_relaxed)+1<JIT_HOT_CALLS) return false;
+            spec = specialize(memory);
+            if(!spec) return false;
+        }
+        if(!spec->load(memory, slots)) return false;
+        reinterpret_cast<NativeBlock>(spec->func)(slots);
+        spec->writeBack(memory, slots, spec->outputs);
+        return true;
+    }
+
+    virtual bool run(BMemory* memory, DataPtr& returnValue, bool &returnSignal, bool forceStayInThread) override {
+        int64_t slots[JIT_MAX_SLOTS];
+        if(!runNative(memory, slots)) return false;
+        NativeSpecialization* spec = native.load(std::memory_order_relaxed);
+        returnValue = fromNative(slots[spec->resultSlot], spec->resultType);
+        returnSignal = false;
+        return true;
+    }
+
+    virtual bool runWithBooleanIntent(BMemory* memory, bool &returnValue, bool forceStayInThread) override {
+        NativeSpecialization* spec = native.load(std::memory_order_acquire);
+        if(spec && (spec->resultType!=JIT_BOOL || segment.commands.back().operation==IS)) return false;
+        int64_t slots[JIT_MAX_SLOTS];
+        if(!runNative(memory, slots)) return false;
+        spec = native.load(std::memory_order_relaxed);
+        if(spec->resultType!=JIT_BOOL || segment.commands.back().operation==IS) 
+            bberror("Internal error: a non-boolean JIT specialization was used as a boolean condition");
+        returnValue = slots[spec->resultSlot];
+        return true;
+    }
+
+    virtual bool runAsLoopBody(BMemory* memory, Jitable* condition, bool forceStayInThread) override {
+        NativeSpecialization* spec = nativeLoop.load(std::memory_order_acquire);
+        if(!spec) {
+            if(loopDisabled.load(std::memory_order_relaxed) || iterations.fetch_add(1, std::memory_order_relaxed)+1<JIT_HOT_ITERATIONS) return false;
+            auto nativeCondition = dynamic_cast<NativeJitable*>(condition);
+            if(!nativeCondition) {loopDisabled.store(true, std::memory_order_relaxed); return false;}
+            spec = specializeLoop(memory, nativeCondition);
+            if(!spec) return false;
+        }
+        if(loopCondition!=condition) return false;
+        int64_t slots[JIT_MAX_SLOTS*2];
+        if(!spec->load(memory, slots)) return false;
+        int64_t ran = reinterpret_cast<NativeLoop>(spec->func)(slots);
+        spec->writeBack(memory, slots, spec->outputs);
+        if(ran) spec->writeBack(memory, slots, spec->loopOutputs);
+        return true;
+    }
+
+    virtual std::string toString() {
+        if(nativeLoop.load(std::memory_order_acquire)) return "JIT: the loop running this block has been compiled to native code";
+        if(native.load(std::memory_order_acquire)) return "JIT: numeric block compiled to native code";
+        return "JIT: numeric block profiled for native compilation";
     }
 };
 
@@ -289,167 +697,7 @@ Jitable* jit(const Code* code) {
     }
 
     if(!allowJit) return nullptr;
-
-    /*std::unordered_map<int, int> assignmentCounts;
-    std::unordered_map<int, int> usageCounts;
-    std::unordered_map<int, int> knownStates;
-    for (int i = start; i <= end; ++i) {
-        const Command& cmd = program->at(i);
-        if(!cmd.nargs || cmd.args[0]==variableManager.noneId) continue;
-        int symbol = cmd.args[0];
-        assignmentCounts[cmd.args[0]]++;
-        if(cmd.nargs>1) usageCounts[cmd.args[1]]++;
-        if(cmd.nargs>2) usageCounts[cmd.args[2]]++;
-        if(cmd.nargs>3) usageCounts[cmd.args[3]]++;
-        knownStates[cmd.args[0]] = END;  // use TOCOPY as an operator that can never be jitted
-    }
-
-    int start_jit_from = -1;
-    for (int i = start; i < end; ++i) {
-        const Command& cmd = program->at(i);
-        if(!cmd.nargs || cmd.args[0]==variableManager.noneId) continue;
-        int prev_known_state = knownStates[cmd.args[0]];
-        knownStates[cmd.args[0]] = cmd.operation;
-        if(cmd.operation==BUILTIN && cmd.value->getType()==BB_FLOAT) knownStates[cmd.args[0]] = TOBB_FLOAT;
-        if(cmd.operation==BUILTIN && cmd.value->getType()==BB_INT) knownStates[cmd.args[0]] = TOBB_INT;
-        if(cmd.operation==BUILTIN && cmd.value->getType()==STRING) knownStates[cmd.args[0]] = TOSTR;
-        if(cmd.operation==ADD && knownStates[cmd.args[1]]==TOBB_FLOAT && knownStates[cmd.args[2]]==TOBB_FLOAT) knownStates[cmd.args[0]] = TOBB_FLOAT;
-        if(cmd.operation==ADD && knownStates[cmd.args[1]]==TOBB_INT && knownStates[cmd.args[2]]==TOBB_FLOAT) knownStates[cmd.args[0]] = TOBB_FLOAT;
-        if(cmd.operation==ADD && knownStates[cmd.args[1]]==TOBB_FLOAT && knownStates[cmd.args[2]]==TOBB_INT) knownStates[cmd.args[0]] = TOBB_FLOAT;
-        if(cmd.operation==ADD && knownStates[cmd.args[1]]==TOBB_INT && knownStates[cmd.args[2]]==TOBB_INT) knownStates[cmd.args[0]] = TOBB_INT;
-        if(cmd.operation==MUL && knownStates[cmd.args[1]]==TOBB_FLOAT && knownStates[cmd.args[2]]==TOBB_FLOAT) knownStates[cmd.args[0]] = TOBB_FLOAT;
-        if(cmd.operation==MUL && knownStates[cmd.args[1]]==TOBB_INT && knownStates[cmd.args[2]]==TOBB_FLOAT) knownStates[cmd.args[0]] = TOBB_FLOAT;
-        if(cmd.operation==MUL && knownStates[cmd.args[1]]==TOBB_FLOAT && knownStates[cmd.args[2]]==TOBB_INT) knownStates[cmd.args[0]] = TOBB_FLOAT;
-        if(cmd.operation==MUL && knownStates[cmd.args[1]]==TOBB_INT && knownStates[cmd.args[2]]==TOBB_INT) knownStates[cmd.args[0]] = TOBB_INT;
-        if(cmd.operation==SUB && knownStates[cmd.args[1]]==TOBB_FLOAT && knownStates[cmd.args[2]]==TOBB_FLOAT) knownStates[cmd.args[0]] = TOBB_FLOAT;
-        if(cmd.operation==SUB && knownStates[cmd.args[1]]==TOBB_INT && knownStates[cmd.args[2]]==TOBB_FLOAT) knownStates[cmd.args[0]] = TOBB_FLOAT;
-        if(cmd.operation==SUB && knownStates[cmd.args[1]]==TOBB_FLOAT && knownStates[cmd.args[2]]==TOBB_INT) knownStates[cmd.args[0]] = TOBB_FLOAT;
-        if(cmd.operation==SUB && knownStates[cmd.args[1]]==TOBB_INT && knownStates[cmd.args[2]]==TOBB_INT) knownStates[cmd.args[0]] = TOBB_INT;
-        if(cmd.operation==DIV && knownStates[cmd.args[1]]==TOBB_FLOAT && knownStates[cmd.args[2]]==TOBB_FLOAT) knownStates[cmd.args[0]] = TOBB_FLOAT;
-        if(cmd.operation==DIV && knownStates[cmd.args[1]]==TOBB_INT && knownStates[cmd.args[2]]==TOBB_FLOAT) knownStates[cmd.args[0]] = TOBB_FLOAT;
-        if(cmd.operation==DIV && knownStates[cmd.args[1]]==TOBB_FLOAT && knownStates[cmd.args[2]]==TOBB_INT) knownStates[cmd.args[0]] = TOBB_FLOAT;
-        if(cmd.operation==DIV && knownStates[cmd.args[1]]==TOBB_INT && knownStates[cmd.args[2]]==TOBB_INT) knownStates[cmd.args[0]] = TOBB_FLOAT;
-        if(cmd.operation==POW && knownStates[cmd.args[1]]==TOBB_FLOAT && knownStates[cmd.args[2]]==TOBB_FLOAT) knownStates[cmd.args[0]] = TOBB_FLOAT;
-        if(cmd.operation==POW && knownStates[cmd.args[1]]==TOBB_INT && knownStates[cmd.args[2]]==TOBB_FLOAT) knownStates[cmd.args[0]] = TOBB_FLOAT;
-        if(cmd.operation==POW && knownStates[cmd.args[1]]==TOBB_FLOAT && knownStates[cmd.args[2]]==TOBB_INT) knownStates[cmd.args[0]] = TOBB_FLOAT;
-        if(cmd.operation==POW && knownStates[cmd.args[1]]==TOBB_INT && knownStates[cmd.args[2]]==TOBB_INT) knownStates[cmd.args[0]] = TOBB_INT;
-        //if(cmd.operation==TOLIST) return nullptr;
-        
-        bool known_state_for_everything = start_jit_from==-1 || prev_known_state==knownStates[cmd.args[0]] || prev_known_state==END;
-        if(cmd.operation==TOLIST)
-            known_state_for_everything = false;
-        if(known_state_for_everything)
-            for (const auto& [symbol, operation] : knownStates) 
-                if (operation != TOBB_FLOAT 
-                    && operation != TOBB_INT 
-                    && operation != TOBB_BOOL
-                    && operation != TOVECTOR
-                    && operation != BUILTIN 
-                    && operation != END 
-                    && usageCounts[cmd.args[0]]) {
-                        known_state_for_everything = false;
-                        break;
-                    }
-
-        //std::cout << "newstate recalc for "<<variableManager.getSymbol(cmd.args[0])<<"\n";
-        //for (const auto& [symbol, operation] : knownStates) 
-        //    std::cout << variableManager.getSymbol(symbol)<< " "<<int2type(operation)<<"\n";
-
-        
-        if(!known_state_for_everything)
-            start_jit_from = -1;
-        else if(start_jit_from==-1)
-            start_jit_from = i;
-
-        assignmentCounts[cmd.args[0]]--;
-        if(cmd.nargs>1) usageCounts[cmd.args[1]]--;
-        if(cmd.nargs>2) usageCounts[cmd.args[2]]--;
-        if(cmd.nargs>3) usageCounts[cmd.args[3]]--;
-    }
-
-
-    // repeat the assignment and usage counts
-    std::unordered_map<int, int> totalAssignmentCounts;
-    assignmentCounts.clear();
-    usageCounts.clear();
-    for (int i = start; i <= end; ++i) {
-        const Command& cmd = program->at(i);
-        if(!cmd.nargs || cmd.args[0]==variableManager.noneId) continue;
-        int symbol = cmd.args[0];
-        assignmentCounts[cmd.args[0]]++;
-        totalAssignmentCounts[cmd.args[0]]++;
-        if(cmd.nargs>1) usageCounts[cmd.args[1]]++;
-        if(cmd.nargs>2) usageCounts[cmd.args[2]]++;
-        if(cmd.nargs>3) usageCounts[cmd.args[3]]++;
-        // CAREFUL NOT TO AFFECT THE KNOWN STATE
-    }
-
-    if(start_jit_from!=-1 && start_jit_from<end-1) {
-        //std::cout << "NEW JIT "<<start<<" to "<<end<<"\n";
-        for (int i = start; i <= start_jit_from; ++i) {
-            const Command& cmd = program->at(i);
-            assignmentCounts[cmd.args[0]]--;
-            if(cmd.nargs>1) usageCounts[cmd.args[1]]--;
-            if(cmd.nargs>2) usageCounts[cmd.args[2]]--;
-            if(cmd.nargs>3) usageCounts[cmd.args[3]]--;
-            //std::cout << "    " << cmd.toString() << "\n";
-        }
-
-        std::unordered_map<int, int> arguments;
-        std::vector<int> argumentOrder;
-        std::string body;
-        body += "  char* _bbjitargs = (char*)_bbjitargsvoid;\n";
-        for (const auto& [symbol, counts] : assignmentCounts) {
-            if(totalAssignmentCounts[symbol]==counts) continue;
-            arguments[symbol] = knownStates[symbol];
-            argumentOrder.push_back(symbol);
-            std::string type = int2type(knownStates[symbol]);
-            body += "  "+type+" "+variableManager.getSymbol(symbol)+"=*("+type+"*)_bbjitargs; _bbjitargs+=sizeof("+type+");\n";
-        }
-        for (const auto& [symbol, counts] : assignmentCounts) {
-            if(totalAssignmentCounts[symbol]!=counts) continue;
-            std::string type = int2type(knownStates[symbol]);
-            body += "  "+type+" "+variableManager.getSymbol(symbol)+";\n";
-        }
-
-        int returnType = END;
-        for (int i = start_jit_from+1; i<end; ++ i) {
-            const Command& com = program->at(i);
-            if(com.operation==ADD) body += "  "+variableManager.getSymbol(com.args[0])+"="+variableManager.getSymbol(com.args[1])+"+"+variableManager.getSymbol(com.args[2])+";\n";
-            else if(com.operation==MUL) body += "  "+variableManager.getSymbol(com.args[0])+"="+variableManager.getSymbol(com.args[1])+"*"+variableManager.getSymbol(com.args[2])+";\n";
-            else if(com.operation==SUB) body += "  "+variableManager.getSymbol(com.args[0])+"="+variableManager.getSymbol(com.args[1])+"-"+variableManager.getSymbol(com.args[2])+";\n";
-            else if(com.operation==BUILTIN) body += "  "+variableManager.getSymbol(com.args[0])+"="+com.value->toString(nullptr)+";\n";
-            else if(com.operation==RETURN){
-                std::string type = int2type(knownStates[com.args[1]]);
-                //body += "  *_bbjitisreturning="+std::to_string(knownStates[com.args[1]])+";\n";
-                //body += "  "+type+"* _bbjitret=("+type+"*)malloc(sizeof("+type+"));\n";
-                //body += "  *_bbjitret = "+variableManager.getSymbol(com.args[1])+";\n";
-                //body += "  return _bbjitret;\n";
-                body += "  return "+variableManager.getSymbol(com.args[1])+";\n";
-                if(returnType!=END && returnType!=knownStates[com.args[1]]) return nullptr;  // if different types are returned per case, we cannot JIT
-                returnType = knownStates[com.args[1]];
-            }
-            else {
-                std::cerr << "Internal error: cannot jit command: " << com.toString() << "\nThis does not indicate critical failure (and will be fixed in the future)\n";
-                return nullptr;
-            }    
-            //body += "    "+com.toString()+"\n";
-        }
-        body = "#include <stdint.h>\n"+int2type(returnType)+" call(void* _bbjitargsvoid) {\n"+body+"}";
-        //std::cout << body << "\n\n";
-        //return nullptr;
-        try {
-            return new JitCode(body, "call", program, start, start_jit_from, arguments, argumentOrder, returnType);
-        }
-        catch(BBError& e) {
-            std::cerr << e.what() << " - JIT is hereby disabled (you might experience slowdowns)\n";
-            allowJit = false;
-            return nullptr;
-        }
-    }*/
-
-
-
-
+    NativeSegment segment(program, start, end);
+    if(segment.eligible) return new NativeJitable(std::move(segment));
     return nullptr;
 }
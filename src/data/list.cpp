@@ -23,25 +23,90 @@
 #include "common.h"
 #include <iostream>
 #include <mutex>
+#include <cstring>
+#include <functional>
 
 extern BError* OUT_OF_RANGE;
 
 // BList constructor
-BList::BList() : Data(LIST), front(0) {}
-BList::BList(int64_t reserve) : Data(LIST), front(0)  {contents.reserve(reserve);}
+BList::BList() : Data(LIST) {}
+BList::BList(int64_t reserve) : Data(LIST)  {contents.reserve(reserve);}
 BList::~BList() {
-    int64_t n = contents.size();
-    for(int64_t i=front;i<n;++i) contents[i].existsRemoveFromOwner();
+    for(size_t i=0;i<contents.size();++i) contents[i].existsRemoveFromOwner();
+}
+
+// ListContents ring buffer
+ListContents::ListContents(ListContents&& other) noexcept : words(other.words), tags(other.tags), kind(other.kind), capacity(other.capacity), head(other.head), count(other.count) {
+    other.words = nullptr;
+    other.tags = nullptr;
+    other.kind = IS_PTR;
+    other.capacity = 0;
+    other.head = 0;
+    other.count = 0;
+}
+
+ListContents& ListContents::operator=(ListContents&& other) noexcept {
+    if(this==&other) return *this;
+    delete[] words;
+    delete[] tags;
+    words = other.words;
+    tags = other.tags;
+    kind = other.kind;
+    capacity = other.capacity;
+    head = other.head;
+    count = other.count;
+    other.words = nullptr;
+    other.tags = nullptr;
+    other.kind = IS_PTR;
+    other.capacity = 0;
+    other.head = 0;
+    other.count = 0;
+    return *this;
+}
+
+void ListContents::reallocate(size_t newCapacity) {
+    int64_t* newWords = new int64_t[newCapacity];
+    DATTYPETYPE* newTags = tags?new DATTYPETYPE[newCapacity]:nullptr;
+    for(size_t i=0;i<count;++i) newWords[i] = words[slot(i)];
+    if(tags) for(size_t i=0;i<count;++i) newTags[i] = tags[slot(i)];
+    delete[] words;
+    delete[] tags;
+    words = newWords;
+    tags = newTags;
+    capacity = newCapacity;
+    head = 0;
+}
+
+void ListContents::generalize() {
+    tags = new DATTYPETYPE[capacity];
+    std::fill(tags, tags+capacity, kind);
+}
+
+void ListContents::reserve(size_t n) {
+    if(n<=capacity) return;
+    size_t newCapacity = 8;
+    while(newCapacity<n) newCapacity *= 2;
+    reallocate(newCapacity);
+}
+
+void ListContents::clear() {
+    delete[] words;
+    delete[] tags;
+    words = nullptr;
+    tags = nullptr;
+    kind = IS_PTR;
+    capacity = 0;
+    head = 0;
+    count = 0;
 }
 
 std::string BList::toString(BMemory* memory){
     std::string result = "(";
     // std::lock_guard<std::recursive_mutex> lock(memoryLock);
-    int64_t n = contents.size();
-    for(int64_t i=front;i<n;++i) {
+    for(const DataPtr& element : contents) {
         if(result.size()>1) result += ", ";
-        if(contents[i].exists()) result += contents[i]->toString(memory); 
-        else result += contents[i].torepr();
+        if(element.exists()) result += element->toString(memory); 
+        else result += element.torepr();
     }
     return result+")";
 }
@@ -49,7 +114,6 @@ std::string BList::toString(BMemory* memory){
 DataPtr BList::at(int64_t index) const {
     if (index < 0) return OUT_OF_RANGE;
     // std::lock_guard<std::recursive_mutex> lock(memoryLock);
-    index += front;
     if (index>=contents.size()) return OUT_OF_RANGE;
     auto res = contents[index];
     return res;
@@ -60,11 +124,22 @@ Vector* BList::toVector(BMemory* memory) const {
     Vector* vec = new Vector(n, false);
     double* rawret = vec->data;
     // std::lock_guard<std::recursive_mutex> lock(memoryLock);
+    DATTYPETYPE type = contents.homogeneousType();
+    if(type==IS_INT || type==IS_FLOAT) {
+        for(int part=0;part<2;++part) {
+            size_t length;
+            const int64_t* words = contents.segment(part, length);
+            if(type==IS_INT) for(size_t i=0;i<length;++i) rawret[i] = (double)words[i];
+            else std::memcpy(rawret, words, length*sizeof(double));
+            rawret += length;
+        }
+        return vec;
+    }
     try {
-        for (int64_t i = front; i < n; ++i) {
+        for (int64_t i = 0; i < n; ++i) {
             const DataPtr& content = contents[i];
-            if (content.isint()) rawret[i-front] = (double)content.unsafe_toint();
-            else if (content.isfloat()) rawret[i-front] = content.unsafe_tofloat();
+            if (content.isint()) rawret[i] = (double)content.unsafe_toint();
+            else if (content.isfloat()) rawret[i] = content.unsafe_tofloat();
             else bberror("Non-numeric value in list during conversion to vector (float or int expected)");
         }
     } 
@@ -76,7 +151,8 @@ BHashMap* BList::toMap() const {
     BHashMap* map = new BHashMap();
     // std::lock_guard<std::recursive_mutex> lock(memoryLock);
     int64_t n = contents.size();
-    for (int64_t i = front; i < n; ++i) {
+    map->reserve(n);
+    for (int64_t i = 0; i < n; ++i) {
         const DataPtr& content = contents[i];
         bbassert(content.existsAndTypeEquals(LIST), "Can only create a map from a list of key,value pairs (list of two-element lists)");
         BList* list = static_cast<BList*>(contents[i].get());
@@ -92,15 +168,24 @@ Result BList::add(BMemory* memory, const DataPtr& other_) {
     // std::lock_guard<std::recursive_mutex> lock(memoryLock);
     std::lock_guard<std::recursive_mutex> otherLock(other->memoryLock);
     BList* ret = new BList(contents.size()+other->contents.size());
-    ret->contents.insert(ret->contents.end(), contents.begin(), contents.end());
-    ret->contents.insert(ret->contents.end(), other->contents.begin(), other->contents.end());
+    for(const DataPtr& dat : contents) ret->contents.push_back(dat);
+    for(const DataPtr& dat : other->contents) ret->contents.push_back(dat);
     for(const DataPtr& dat : ret->contents) dat.existsAddOwner();
     return RESMOVE(Result(ret));
 }
 
+void BList::share() {
+    if(isShared()) return;
+    Data::share();
+    std::lock_guard<std::recursive_mutex> lock(memoryLock);
+    for(const auto& element : contents) element.existsShare();
+}
+
 Result BList::push(BMemory* memory, const DataPtr& other) {
     if(other.existsAndTypeEquals(ERRORTYPE)) bberror(other->toString(nullptr));
     bbassert(other.islitorexists(), "Cannot push a missing value to a list");
+    if(isShared()) other.existsShare();
+    if(other.existsAndTypeEquals(VECTOR)) static_cast<Vector*>(other.get())->materialize();
     other.existsAddOwner();
     // std::lock_guard<std::recursive_mutex> lock(memoryLock);
     contents.emplace_back(other);
@@ -110,7 +195,7 @@ Result BList::push(BMemory* memory, const DataPtr& other) {
 Result BList::pop(BMemory* memory) {
     // std::lock_guard<std::recursive_mutex> lock(memoryLock);
     if (contents.empty()) return RESMOVE(Result(OUT_OF_RANGE));
-    auto& element = contents.back();
+    DataPtr element = contents.back();
     auto ret = Result(element);
     contents.pop_back();
     element.existsRemoveFromOwner();
@@ -119,11 +204,10 @@ Result BList::pop(BMemory* memory) {
 
 Result BList::next(BMemory* memory) {
     // std::lock_guard<std::recursive_mutex> lock(memoryLock);
-    if (front >= contents.size()) return RESMOVE(Result(OUT_OF_RANGE));
-    auto& element = contents[front];
+    if (contents.empty()) return RESMOVE(Result(OUT_OF_RANGE));
+    DataPtr element = contents.front();
     auto ret = Result(element);
-    front++;
-    resizeContents();
+    contents.pop_front();
     element.existsRemoveFromOwner();
     return std::move(ret);
 }
@@ -132,7 +216,6 @@ Result BList::at(BMemory* memory, const DataPtr& other) {
     if (other.isint()) {
         int64_t index = other.unsafe_toint();
         if (index < 0) return RESMOVE(Result(OUT_OF_RANGE));
-        index += front;
         if (index>=contents.size()) return RESMOVE(Result(OUT_OF_RANGE));
         // std::lock_guard<std::recursive_mutex> lock(memoryLock);
         const DataPtr& res = contents[index];
@@ -148,10 +231,8 @@ Result BList::at(BMemory* memory, const DataPtr& other) {
             int64_t start = iterPtr->getStart();
             int64_t end = iterPtr->getEnd();
             if (start < 0) return RESMOVE(Result(OUT_OF_RANGE));
-            start += front;
             if (start>=contents.size()) return RESMOVE(Result(OUT_OF_RANGE));
             if (end < 0) return RESMOVE(Result(OUT_OF_RANGE));
-            end += front;
             if (end>=contents.size()) return RESMOVE(Result(OUT_OF_RANGE));
             BList* ret = new BList(end - start);
             for (int64_t i = start; i < end; ++i) {
@@ -170,7 +251,6 @@ Result BList::at(BMemory* memory, const DataPtr& other) {
             bbassert(indexData.isint(), "Iterable list indexes can only contain integers.");
             int64_t id = indexData.unsafe_toint();
             if (id < 0) return RESMOVE(Result(OUT_OF_RANGE));
-            id += front;
             if (id>=contents.size()) return RESMOVE(Result(OUT_OF_RANGE));
             const auto& element = contents[id];
             element.existsAddOwner();
@@ -186,12 +266,13 @@ Result BList::put(BMemory* memory, const DataPtr& position, const DataPtr& value
     int64_t index = position.unsafe_toint();
     if (index < 0) return RESMOVE(Result(OUT_OF_RANGE));
     // std::lock_guard<std::recursive_mutex> lock(memoryLock);
-    index += front;
     if (index>=contents.size()) return RESMOVE(Result(OUT_OF_RANGE));
     bbassert(value.islitorexists(), "Cannot set a missing value on a list");
     if(value.existsAndTypeEquals(ERRORTYPE)) bberror(value->toString(nullptr));
+    if(value.existsAndTypeEquals(VECTOR)) static_cast<Vector*>(value.get())->materialize();
     DataPtr prev = contents[index];
-    contents[index] = value;
+    contents.set(index, value);
+    if(isShared()) value.existsShare();
     value.existsAddOwner();
     prev.existsRemoveFromOwner();
     return RESMOVE(Result(DataPtr::NULLP));
@@ -199,44 +280,50 @@ Result BList::put(BMemory* memory, const DataPtr& position, const DataPtr& value
 
 int64_t BList::len(BMemory* memory) {
     // std::lock_guard<std::recursive_mutex> lock(memoryLock);
-    return contents.size()-front;
+    return contents.size();
 }
 
 Result BList::iter(BMemory* memory) {
     // std::lock_guard<std::recursive_mutex> lock(memoryLock);
-    return RESMOVE(Result(new AccessIterator(this, contents.size()-front)));
+    return RESMOVE(Result(new AccessIterator(this, contents.size())));
 }
 
 void BList::clear(BMemory* memory)  {
     // std::lock_guard<std::recursive_mutex> lock(memoryLock);
-    int64_t n = contents.size();
-    for(int64_t i=front;i<n;++i) contents[i].existsRemoveFromOwner();
-    contents = std::vector<DataPtr>();
-    front = 0;
+    for(size_t i=0;i<contents.size();++i) contents[i].existsRemoveFromOwner();
+    contents.clear();
 }
 
 Result BList::move(BMemory* memory) {
     BList* ret = new BList();
     // std::lock_guard<std::recursive_mutex> lock(memoryLock);
-    ret->front = front;
     ret->contents = std::move(contents);
-    contents.clear();
-    front = 0;
     return RESMOVE(Result(ret));
 }
 
-void BList::resizeContents() {
-    if(front>32 && front>contents.size()/3) {
-        contents.erase(contents.begin(), contents.begin() + front);
-        front = 0;
+// extremum of packed int or float payloads, without checking the type of each element
+template <typename T, typename Compare>
+static T packedExtremum(const ListContents& contents, Compare better) {
+    size_t length;
+    T result = std::bit_cast<T>(contents.segment(0, length)[0]);
+    for(int part=0;part<2;++part) {
+        const int64_t* words = contents.segment(part, length);
+        for(size_t i=0;i<length;++i) {
+            T value = std::bit_cast<T>(words[i]);
+            if(better(value, result)) result = value;
+        }
     }
+    return result;
 }
 
 Result BList::min(BMemory* memory) {
     // std::lock_guard<std::recursive_mutex> lock(memoryLock);
-    if (contents.size() == front) return Result(OUT_OF_RANGE);
-    DataPtr minValue = contents[front];
-    for (int i = front+1; i < contents.size(); ++i) {
+    if (contents.empty()) return Result(OUT_OF_RANGE);
+    DATTYPETYPE type = contents.homogeneousType();
+    if(type==IS_INT) return Result(DataPtr(packedExtremum<int64_t>(contents, std::less<int64_t>())));
+    if(type==IS_FLOAT) return Result(DataPtr(packedExtremum<double>(contents, std::less<double>())));
+    DataPtr minValue = contents[0];
+    for (int i = 1; i < contents.size(); ++i) {
         const auto& arg0 = contents[i];
         const auto& arg1 = minValue;
         if(arg0.isint() && arg1.isint()) {if(arg0.unsafe_toint()<arg1.unsafe_toint()) minValue=arg0;continue;}
@@ -256,9 +343,12 @@ Result BList::min(BMemory* memory) {
 
 Result BList::max(BMemory* memory) {
     // std::lock_guard<std::recursive_mutex> lock(memoryLock);
-    if (contents.size() == front) return Result(OUT_OF_RANGE);
-    DataPtr maxValue = contents[front];
-    for (int i = front+1; i < contents.size(); ++i) {
+    if (contents.empty()) return Result(OUT_OF_RANGE);
+    DATTYPETYPE type = contents.homogeneousType();
+    if(type==IS_INT) return Result(DataPtr(packedExtremum<int64_t>(contents, std::greater<int64_t>())));
+    if(type==IS_FLOAT) return Result(DataPtr(packedExtremum<double>(contents, std::greater<double>())));
+    DataPtr maxValue = contents[0];
+    for (int i = 1; i < contents.size(); ++i) {
         const auto& arg0 = contents[i];
         const auto& arg1 = maxValue;
         if(arg0.isint() && arg1.isint()) {if(arg0.unsafe_toint()>arg1.unsafe_toint()) maxValue=arg0;continue;}
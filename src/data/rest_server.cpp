@@ -39,8 +39,10 @@ std::vector<std::string> splitRoute(const std::string& route) {
 extern std::recursive_mutex printMutex;
 int RestServer::resultType = variableManager.getId("type");
 
-RestServer::RestServer(BMemory* attachedMemory, int port) : Data(SERVER), port_(port), context_(nullptr), attachedMemory(attachedMemory) {runServer();}
+// route handlers run on the server's threads and read the memory in which the server was created
+RestServer::RestServer(BMemory* attachedMemory, int port) : Data(SERVER), port_(port), context_(nullptr), attachedMemory(attachedMemory) {attachedMemory->markShared();runServer();}
 RestServer::RestServer(BMemory* attachedMemory, RestServer* prototype) : Data(SERVER), port_(prototype->port_), context_(prototype->context_), attachedMemory(attachedMemory){
+    attachedMemory->markShared();
     routeHandlers_ = std::move(prototype->routeHandlers_);
     mg_set_request_handler(context_, "/", requestHandler, (void*)this);
 }
@@ -59,6 +61,7 @@ Result RestServer::put(BMemory* callerMemory,const DataPtr& route, const DataPtr
     if(routeHandlers_[actualRoute]!=actualCode) {
         if(routeHandlers_[actualRoute]) routeHandlers_[actualRoute]->removeFromOwner();
         routeHandlers_[actualRoute] = actualCode;
+        actualCode->share();
         actualCode->addOwner();
     }
     return RESMOVE(Result(DataPtr::NULLP));
@@ -107,7 +110,7 @@ Result RestServer::executeCodeWithMemory(DataPtr called, BMemory* memory) const
     Code* code = static_cast<Code*>(called.get());
 
 
-    BMemory newMemory(memory->getDepth(), memory, LOCAL_EXPECTATION_FROM_CODE(code));
+    BMemory newMemory(memory->getDepth(), memory, LOCAL_EXPECTATION_FROM_CODE(code), code->layout);
     DataPtr result;
     //newMemory.detach(code->getDeclarationMemory());
     //newMemory.detach(memory);
@@ -163,12 +166,12 @@ int RestServer::requestHandler(struct mg_connection* conn, void* cbdata) {
             if (!isMatch) continue;
 
             try {
-                if(req_info->request_uri) mem.set(variableManager.getId("server::uri"), new BString(req_info->request_uri));
-                if(req_info->query_string) mem.set(variableManager.getId("server::query"), new BString(req_info->query_string));
-                if(req_info->request_method) mem.set(variableManager.getId("server::method"), new BString(req_info->request_method));
-                if(req_info->http_version) mem.set(variableManager.getId("server::http"), new BString(req_info->http_version));
-                mem.set(variableManager.getId("server::ip"), new BString(req_info->remote_addr));
-                mem.set(variableManager.getId("server::ssl"), (bool)req_info->is_ssl);
+                if(req_info->request_uri) mem.set(variableManager.serverUri, new BString(req_info->request_uri));
+                if(req_info->query_string) mem.set(variableManager.serverQuery, new BString(req_info->query_string));
+                if(req_info->request_method) mem.set(variableManager.serverMethod, new BString(req_info->request_method));
+                if(req_info->http_version) mem.set(variableManager.serverHttp, new BString(req_info->http_version));
+                mem.set(variableManager.serverIp, new BString(req_info->remote_addr));
+                mem.set(variableManager.serverSsl, (bool)req_info->is_ssl);
                 //mem.setFinal(variableManager.getId("ip"));
                 //mem.setFinal(variableManager.getId("ssl"));
 
@@ -179,7 +182,7 @@ int RestServer::requestHandler(struct mg_connection* conn, void* cbdata) {
                     if (bytesRead > 0) {
                         bodyData[bytesRead] = '\0';
                         std::string requestBody(&bodyData[0]);
-                        mem.set(variableManager.getId("server::content"), new BString(requestBody));
+                        mem.set(variableManager.serverContent, new BString(requestBody));
                     }
                 }
 
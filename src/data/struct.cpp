@@ -33,7 +33,7 @@ Result Struct::simpleImplement(int implementationCode, BMemory* calledMemory) {
     DataPtr implementation;
     unsigned int depth = calledMemory->getDepth();
     {
-        std::lock_guard<std::recursive_mutex> lock(memoryLock);
+        OwnedLock lock(this, memoryLock);
         implementation = getOrNull(implementationCode);
     }
 
@@ -60,7 +60,7 @@ Result Struct::simpleImplement(int implementationCode, BMemory* calledMemory) {
     CodeExiter codeExiter(code);*/
     BList* args = new BList(0);
 
-    BMemory newMemory(depth, calledMemory->getParentWithFinals(), LOCAL_EXPECTATION_FROM_CODE(code));
+    BMemory newMemory(depth, calledMemory->getParentWithFinals(), LOCAL_EXPECTATION_FROM_CODE(code), code->layout);
     newMemory.unsafeSet(variableManager.thisId, this);
     newMemory.unsafeSet(variableManager.argsId, args);
 
@@ -73,7 +73,7 @@ Result Struct::simpleImplement(int implementationCode, BMemory* calledMemory, co
     DataPtr implementation;
     unsigned int depth = calledMemory->getDepth();
     {
-        std::lock_guard<std::recursive_mutex> lock(memoryLock);
+        OwnedLock lock(this, memoryLock);
         implementation = getOrNull(implementationCode);
     }
 
@@ -102,7 +102,7 @@ Result Struct::simpleImplement(int implementationCode, BMemory* calledMemory, co
     other.existsAddOwner();
     args->contents.emplace_back(other);
 
-    BMemory newMemory(depth, calledMemory->getParentWithFinals(), LOCAL_EXPECTATION_FROM_CODE(code));
+    BMemory newMemory(depth, calledMemory->getParentWithFinals(), LOCAL_EXPECTATION_FROM_CODE(code), code->layout);
     newMemory.unsafeSet(variableManager.thisId, this);
     newMemory.unsafeSet(variableManager.argsId, args);
 
@@ -110,55 +110,105 @@ Result Struct::simpleImplement(int implementationCode, BMemory* calledMemory, co
     return executor.run(code).result;
 }
 
-Struct::Struct() : Data(STRUCT) {countUnrealeasedMemories++;}
-Struct::Struct(int defaultSize) : Data(STRUCT) {data.reserve(defaultSize);countUnrealeasedMemories++;}
+std::atomic<unsigned int> countShapes(0);
+
+StructShape::StructShape() : id(++countShapes) {}
+
+StructShape::StructShape(const StructShape* prev, int field) : id(++countShapes), fields(prev->fields) {
+    fields.push_back(field);
+    if(fields.size()>8) for(unsigned int i=0;i<fields.size();++i) slots[fields[i]] = i;
+}
+
+const StructShape* StructShape::empty() {
+    static StructShape root;
+    return &root;
+}
+
+const StructShape* StructShape::withField(int field) const {
+    std::lock_guard<std::mutex> lock(transitionLock);
+    auto it = transitions.find(field);
+    if(it!=transitions.end()) return it->second;
+    StructShape* next = new StructShape(this, field);
+    transitions[field] = next;
+    return next;
+}
+
+Struct::Struct() : Data(STRUCT), shape(StructShape::empty()) {countUnrealeasedMemories++;}
+Struct::Struct(int defaultSize) : Data(STRUCT), shape(StructShape::empty()) {fields.reserve(defaultSize);countUnrealeasedMemories++;}
 Struct::~Struct() {countUnrealeasedMemories--;releaseMemory();}
 
+int Struct::addField(int id) {
+    shape = shape->withField(id);
+    fields.emplace_back(DataPtr::NULLP);
+    return fields.size()-1;
+}
+
 DataPtr Struct::get(int id) const {
-    auto item = data.find(id);
-    if (item == data.end()) bberror("Cannot find struct field: " + variableManager.getSymbol(id));
-    return item->second;
+    int slot = shape->slot(id);
+    if (slot<0) bberror("Cannot find struct field: " + variableManager.getSymbol(id));
+    return fields[slot];
 }
 
 DataPtr Struct::getOrNull(int id) const {
-    auto item = data.find(id);
-    if (item == data.end()) return DataPtr::NULLP;
-    return item->second;
+    int slot = shape->slot(id);
+    if (slot<0) return DataPtr::NULLP;
+    return fields[slot];
 }
 
 void Struct::set(int id, const DataPtr& value) {
-    std::lock_guard<std::recursive_mutex> lock(memoryLock);
-    value.existsAddOwner();
-    if(data.find(id)!=data.end()){
-        DataPtr prev = data[id];
-        if(prev.isA()) bberror("Cannot overwrite final struct field: " + variableManager.getSymbol(id));
-        //if(prev.existsAndTypeEquals(ERRORTYPE) && !static_cast<BError*>(prev.get())->isConsumed()) bberror("Trying to overwrite an unhandled error:\n"+prev->toString(this));
-        prev.existsRemoveFromOwner();
+    OwnedLock lock(this, memoryLock);
+    int slot = shape->slot(id);
+    if(slot<0) {
+        if(isShared()) value.existsShare();
+        value.existsAddOwner();
+        slot = addField(id);
+        fields[slot] = value;
+        fields[slot].setAFalse();
     }
-    data[id] = value;
-    data[id].setAFalse();
+    else setAt(slot, value);
+}
+
+void Struct::setAt(int slot, const DataPtr& value) {
+    DataPtr prev = fields[slot];
+    if(prev.isA()) bberror("Cannot overwrite final struct field: " + variableManager.getSymbol(shape->fields[slot]));
+    if(isShared()) value.existsShare();
+    value.existsAddOwner();
+    //if(prev.existsAndTypeEquals(ERRORTYPE) && !static_cast<BError*>(prev.get())->isConsumed()) bberror("Trying to overwrite an unhandled error:\n"+prev->toString(this));
+    prev.existsRemoveFromOwner();
+    fields[slot] = value;
+    fields[slot].setAFalse();
 }
 
 void Struct::transferNoChecks(int id, const DataPtr& value) {
-    data[id] = value;
+    int slot = shape->slot(id);
+    if(slot<0) slot = addField(id);
+    if(isShared()) value.existsShare();
+    fields[slot] = value;
+}
+
+void Struct::share() {
+    if(isShared()) return;
+    Data::share();
+    std::lock_guard<std::recursive_mutex> lock(memoryLock);
+    for(const auto& field : fields) field.existsShare();
 }
 
 void Struct::transferToMemory(BMemory* scopeMemory) {
     std::lock_guard<std::recursive_mutex> lock(memoryLock);
-    for(const auto& dat_ : data) scopeMemory->set(dat_.first, dat_.second);
+    for(unsigned int slot=0;slot<fields.size();++slot) scopeMemory->set(shape->fields[slot], fields[slot]);
 }
 
 void Struct::releaseMemory() {
     std::lock_guard<std::recursive_mutex> lock(memoryLock);
     std::string destroyerr;
-    for(const auto& dat_ : data) {
-        auto dat = dat_.second;
+    for(auto dat : fields) {
         try {
            dat.existsRemoveFromOwner();
         }
         catch(const BBError& e) {destroyerr += std::string(e.what())+"\n";}
     }
-    data.clear();
+    fields.clear();
+    shape = StructShape::empty();
     if(destroyerr.size()) throw BBError(destroyerr.substr(0, destroyerr.size()-1));
 }
 
@@ -215,8 +265,10 @@ Result Struct::move(BMemory* scopeMemory) {
 
     std::lock_guard<std::recursive_mutex> lock(memoryLock);
     Struct* ret = new Struct();
-    ret->data = std::move(data);
-    data = tsl::hopscotch_map<int, DataPtr>();
+    ret->shape = shape;
+    ret->fields = std::move(fields);
+    fields = std::vector<DataPtr>();
+    shape = StructShape::empty();
     return RESMOVE(Result(DataPtr(ret)));
 }
 
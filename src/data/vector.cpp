@@ -19,22 +19,385 @@
 #include "common.h"
 #include "data/Iterator.h"
 #include "data/BError.h"
+#include "data/List.h"
+#include "interpreter/ThreadPool.h"
 #include <iostream>
 #include <cmath>
+#include <vector>
+#include <atomic>
 
 extern BError* OUT_OF_RANGE;
 extern BError* INCOMPATIBLE_SIZES;
 
-Vector::Vector(uint64_t size) : size(size), Data(VECTOR) {data = (double*)malloc(size*sizeof(double));}
+#define VECTOR_TILE 256         // elements evaluated at a time by each step of an expression
+#define VECTOR_LAZY_SIZE 1024   // smaller results are computed immediately
+#define VECTOR_MAX_STEPS 16     // longer chains materialize their operands first
+#define VECTOR_CHUNK 4096       // elements reduced into each partial result
+#define VECTOR_PARALLEL_SIZE 65536 // smaller vectors are processed by one thread
+
+static int vectorThreads = 1;
+void Vector::setMaxThreads(int maxThreads) {vectorThreads = std::max(maxThreads, 1);}
+// pool workers already occupy the other threads, so only code running outside the pool opens OpenMP teams
+static inline int teamThreads() {return ThreadPool::isWorker()?1:vectorThreads;}
+static std::atomic<long long> vectorMaterializations(0);
+long long Vector::materializations() {return vectorMaterializations.load(std::memory_order_relaxed);}
+
+enum VectorOperation {VEC_ADD, VEC_SUB, VEC_RSUB, VEC_MUL, VEC_DIV, VEC_RDIV, VEC_POW, VEC_RPOW, VEC_LOG,
+                      VEC_LT, VEC_LE, VEC_GT, VEC_GE, VEC_EQ, VEC_NEQ};
+enum VectorReduction {VEC_SUM, VEC_MIN, VEC_MAX};
+enum VectorOperandKind {OPERAND_INPUT, OPERAND_STEP, OPERAND_SCALAR, OPERAND_NONE};
+
+struct VectorOperand {
+    VectorOperandKind kind;
+    int index;
+    double scalar;
+};
+
+struct VectorStep {
+    VectorOperation operation;
+    VectorOperand left;  // always an input or a step
+    VectorOperand right;
+};
+
+// kept out of line, otherwise the running total is spilled to memory around evaluate on every element
+[[gnu::noinline]] static double accumulate(VectorReduction reduction, const double* tile, int count, double total) {
+    if(reduction==VEC_SUM) {
+        // independent partial sums can be vectorized, and their order is fixed so results are reproducible
+        double lanes[4] = {total, 0, 0, 0};
+        int i = 0;
+        for(;i+4<=count;i+=4) for(int lane=0;lane<4;++lane) lanes[lane] += tile[i+lane];
+        for(;i<count;++i) lanes[0] += tile[i];
+        return (lanes[0]+lanes[1])+(lanes[2]+lanes[3]);
+    }
+    else if(reduction==VEC_MIN) for(int i=0;i<count;++i) {if(tile[i] < total) total = tile[i];}
+    else for(int i=0;i<count;++i) {if(tile[i] > total) total = tile[i];}
+    return total;
+}
+
+// Partial results of consecutive chunks are summed pairwise, which keeps rounding errors low and the outcome 
+// the same regardless of how many threads computed them.
+static double combine(VectorReduction reduction, const double* partials, int64_t count) {
+    if(count==0) return 0;
+    if(count==1) return partials[0];
+    if(reduction!=VEC_SUM) {
+        double total = partials[0];
+        for(int64_t i=1;i<count;++i) total = reduction==VEC_MIN?std::min(total, partials[i]):std::max(total, partials[i]);
+        return total;
+    }
+    int64_t half = count/2;
+    return combine(reduction, partials, half) + combine(reduction, partials+half, count-half);
+}
+
+// Elementwise steps over input buffers. Each step is evaluated tile by tile into a register that later steps read,
+// so that every input is streamed from memory only once regardless of how many operations are chained.
+class VectorExpression {
+public:
+    uint64_t size;
+    std::vector<const double*> inputs;
+    std::vector<std::shared_ptr<double[]>> owners; // keep the buffers of inputs alive
+    std::vector<VectorStep> steps;
+
+    explicit VectorExpression(uint64_t size) : size(size) {}
+
+    // inputs are contiguous, but may start anywhere within their owner's buffer
+    VectorOperand absorb(const std::shared_ptr<double[]>& owner, const double* data) {
+        for(int i=0;i<inputs.size();++i) if(inputs[i]==data) return {OPERAND_INPUT, i, 0};
+        inputs.push_back(data);
+        owners.push_back(owner);
+        return {OPERAND_INPUT, static_cast<int>(inputs.size())-1, 0};
+    }
+
+    VectorOperand absorb(const VectorExpression& other) {
+        int stepOffset = steps.size();
+        std::vector<int> remapped;
+        for(int i=0;i<other.inputs.size();++i) remapped.push_back(absorb(other.owners[i], other.inputs[i]).index);
+        for(VectorStep step : other.steps) {
+            for(VectorOperand* operand : {&step.left, &step.right}) {
+                if(operand->kind==OPERAND_INPUT) operand->index = remapped[operand->index];
+                else if(operand->kind==OPERAND_STEP) operand->index += stepOffset;
+            }
+            steps.push_back(step);
+        }
+        return {OPERAND_STEP, static_cast<int>(steps.size())-1, 0};
+    }
+
+    // Evaluates positions [start, start+count) of all steps. The last one is written to out.
+    void evaluate(uint64_t start, int count, double* registers, double* out) const {
+        int n = steps.size();
+        for(int k=0;k<n;++k) {
+            const VectorStep& step = steps[k];
+            double* result = k==n-1?out:registers+k*VECTOR_TILE;
+            const double* x = step.left.kind==OPERAND_INPUT?inputs[step.left.index]+start:registers+step.left.index*VECTOR_TILE;
+            if(step.right.kind==OPERAND_SCALAR || step.right.kind==OPERAND_NONE) {
+                double val = step.right.scalar;
+                switch(step.operation) {
+                    case VEC_ADD: {
+                        #pragma omp simd
+                        for(int i=0;i<count;++i) result[i] = x[i] + val;
+                        break;
+                    }
+                    case VEC_SUB: {
+                        #pragma omp simd
+                        for(int i=0;i<count;++i) result[i] = x[i] - val;
+                        break;
+                    }
+                    case VEC_RSUB: {
+                        #pragma omp simd
+                        for(int i=0;i<count;++i) result[i] = val - x[i];
+                        break;
+                    }
+                    case VEC_MUL: {
+                        #pragma omp simd
+                        for(int i=0;i<count;++i) result[i] = x[i] * val;
+                        break;
+                    }
+                    case VEC_DIV: {
+                        #pragma omp simd
+                        for(int i=0;i<count;++i) result[i] = x[i] / val;
+                        break;
+                    }
+                    case VEC_RDIV: {
+                        #pragma omp simd
+                        for(int i=0;i<count;++i) result[i] = val / x[i];
+                        break;
+                    }
+                    case VEC_POW: for(int i=0;i<count;++i) result[i] = std::pow(x[i], val); break;
+                    case VEC_RPOW: for(int i=0;i<count;++i) result[i] = std::pow(val, x[i]); break;
+                    case VEC_LOG: for(int i=0;i<count;++i) result[i] = std::log(x[i]); break;
+                    case VEC_LT: {
+                        #pragma omp simd
+                        for(int i=0;i<count;++i) result[i] = x[i] < val;
+                        break;
+                    }
+                    case VEC_LE: {
+                        #pragma omp simd
+                        for(int i=0;i<count;++i) result[i] = x[i] <= val;
+                        break;
+                    }
+                    case VEC_GT: {
+                        #pragma omp simd
+                        for(int i=0;i<count;++i) result[i] = x[i] > val;
+                        break;
+                    }
+                    case VEC_GE: {
+                        #pragma omp simd
+                        for(int i=0;i<count;++i) result[i] = x[i] >= val;
+                        break;
+                    }
+                    case VEC_EQ: {
+                        #pragma omp simd
+                        for(int i=0;i<count;++i) result[i] = x[i] == val;
+                        break;
+                    }
+                    case VEC_NEQ: {
+                        #pragma omp simd
+                        for(int i=0;i<count;++i) result[i] = x[i] != val;
+                        break;
+                    }
+                }
+                continue;
+            }
+            const double* y = step.right.kind==OPERAND_INPUT?inputs[step.right.index]+start:registers+step.right.index*VECTOR_TILE;
+            switch(step.operation) {
+                case VEC_ADD: {
+                    #pragma omp simd
+                    for(int i=0;i<count;++i) result[i] = x[i] + y[i];
+                    break;
+                }
+                case VEC_SUB: {
+                    #pragma omp simd
+                    for(int i=0;i<count;++i) result[i] = x[i] - y[i];
+                    break;
+                }
+                case VEC_MUL: {
+                    #pragma omp simd
+                    for(int i=0;i<count;++i) result[i] = x[i] * y[i];
+                    break;
+                }
+                case VEC_DIV: {
+                    #pragma omp simd
+                    for(int i=0;i<count;++i) result[i] = x[i] / y[i];
+                    break;
+                }
+                case VEC_POW: for(int i=0;i<count;++i) result[i] = std::pow(x[i], y[i]); break;
+                case VEC_LT: {
+                    #pragma omp simd
+                    for(int i=0;i<count;++i) result[i] = x[i] < y[i];
+                    break;
+                }
+                case VEC_LE: {
+                    #pragma omp simd
+                    for(int i=0;i<count;++i) result[i] = x[i] <= y[i];
+                    break;
+                }
+                case VEC_GT: {
+                    #pragma omp simd
+                    for(int i=0;i<count;++i) result[i] = x[i] > y[i];
+                    break;
+                }
+                case VEC_GE: {
+                    #pragma omp simd
+                    for(int i=0;i<count;++i) result[i] = x[i] >= y[i];
+                    break;
+                }
+                case VEC_EQ: {
+                    #pragma omp simd
+                    for(int i=0;i<count;++i) result[i] = x[i] == y[i];
+                    break;
+                }
+                case VEC_NEQ: {
+                    #pragma omp simd
+                    for(int i=0;i<count;++i) result[i] = x[i] != y[i];
+                    break;
+                }
+                default: bberror("Internal error: unsupported vector operation between vectors");
+            }
+        }
+    }
+
+    void materialize(double* out) const {
+        int64_t tiles = (size+VECTOR_TILE-1)/VECTOR_TILE;
+        int team = teamThreads();
+        #pragma omp parallel num_threads(team) if(size>=VECTOR_PARALLEL_SIZE && team>1)
+        {
+            std::vector<double> registers(steps.size()*VECTOR_TILE);
+            #pragma omp for schedule(static)
+            for(int64_t tile=0;tile<tiles;++tile) {
+                uint64_t start = tile*VECTOR_TILE;
+                evaluate(start, std::min<uint64_t>(VECTOR_TILE, size-start), registers.data(), out+start);
+            }
+        }
+    }
+
+    // Reductions consume tiles as they are evaluated, without ever storing the whole outcome.
+    double reduce(VectorReduction reduction) const {
+        int64_t chunks = (size+VECTOR_CHUNK-1)/VECTOR_CHUNK;
+        std::vector<double> partials(chunks);
+        int team = teamThreads();
+        #pragma omp parallel num_threads(team) if(size>=VECTOR_PARALLEL_SIZE && team>1)
+        {
+            std::vector<double> registers(steps.size()*VECTOR_TILE);
+            double tile[VECTOR_TILE];
+            #pragma omp for schedule(static)
+            for(int64_t chunk=0;chunk<chunks;++chunk) {
+                uint64_t first = chunk*VECTOR_CHUNK;
+                uint64_t end = std::min<uint64_t>(size, first+VECTOR_CHUNK);
+                double total = 0;
+                for(uint64_t start=first;start<end;start+=VECTOR_TILE) {
+                    int count = std::min<uint64_t>(VECTOR_TILE, end-start);
+                    evaluate(start, count, registers.data(), tile);
+                    total = accumulate(reduction, tile, count, start==first && reduction!=VEC_SUM?tile[0]:total);
+                }
+                partials[chunk] = total;
+            }
+        }
+        return combine(reduction, partials.data(), chunks);
+    }
+};
+
+Vector::Vector(uint64_t size) : Data(VECTOR), size(size), step(1), shape({static_cast<int64_t>(size)}), strides({1}), pendingUses(0) {
+    buffer = std::shared_ptr<double[]>(new double[size]);
+    data = buffer.get();
+}
 Vector::Vector(uint64_t size, bool setToZero) : Vector(size) {if (setToZero) std::fill(data, data + size, 0);}
-Vector::~Vector() {std::free(data);}
+Vector::Vector(const std::shared_ptr<VectorExpression>& pending) : Data(VECTOR), data(nullptr), size(pending->size), step(1), shape({static_cast<int64_t>(pending->size)}), strides({1}), pending(pending), pendingUses(0) {}
+Vector::Vector(const std::shared_ptr<double[]>& buffer, double* data, const std::vector<int64_t>& shape) : Data(VECTOR), buffer(buffer), data(data), step(1), shape(shape), pendingUses(0) {
+    size = 1;
+    strides.resize(shape.size());
+    for(int i=shape.size()-1;i>=0;--i) {
+        strides[i] = size;
+        size *= shape[i];
+    }
+}
+Vector::Vector(const std::shared_ptr<double[]>& buffer, double* data, uint64_t size, int64_t step) 
+    : Data(VECTOR), buffer(buffer), data(data), size(size), step(step), shape({static_cast<int64_t>(size)}), strides({1}), pendingUses(0) {}
+Vector::~Vector() {}
+
+void Vector::materialize() {
+    OwnedLock lock(this, memoryLock);
+    if(!pending) return;
+    vectorMaterializations.fetch_add(1, std::memory_order_relaxed);
+    buffer = std::shared_ptr<double[]>(new double[size]);
+    data = buffer.get();
+    pending->materialize(data);
+    pending = nullptr;
+}
+
+void Vector::compact() {
+    OwnedLock lock(this, memoryLock);
+    // pending expressions always produce contiguous results, so only strided views need copying
+    if(pending || step==1) return;
+    auto copied = std::shared_ptr<double[]>(new double[size]);
+    for(uint64_t i=0;i<size;++i) copied[i] = data[i*step];
+    buffer = copied;
+    data = buffer.get();
+    step = 1;
+}
+
+Result Vector::elementwise(int operation, const DataPtr& other, const char* name) {
+    OwnedLock lock(this, memoryLock);
+    Vector* vec = nullptr;
+    if(!other.isfloat() && !other.isint() && operation!=VEC_LOG) {
+        bbassert(other.existsAndTypeEquals(VECTOR), "No builtin implementation for "+std::string(name)+"(vector, "+other.torepr()+")");
+        vec = static_cast<Vector*>(other.get());
+        if(vec->size!=size) return Result(INCOMPATIBLE_SIZES);
+    }
+    auto expression = std::make_shared<VectorExpression>(size);
+    if(pending && (pendingUses++ || pending->steps.size()+1>VECTOR_MAX_STEPS)) materialize();
+    compact();
+    VectorOperand left = pending?expression->absorb(*pending):expression->absorb(buffer, data);
+    VectorOperand right = {OPERAND_NONE, 0, 0};
+    if(vec) {
+        OwnedLock otherLock(vec, vec->memoryLock);
+        if(vec->pending && (vec->pendingUses++ || expression->steps.size()+vec->pending->steps.size()+1>VECTOR_MAX_STEPS)) vec->materialize();
+        vec->compact();
+        right = vec->pending?expression->absorb(*vec->pending):expression->absorb(vec->buffer, vec->data);
+    }
+    else if(operation!=VEC_LOG) right = {OPERAND_SCALAR, 0, other.isfloat()?other.unsafe_tofloat():other.unsafe_toint()};
+    expression->steps.push_back({static_cast<VectorOperation>(operation), left, right});
+    Vector* result = new Vector(expression);
+    result->shape = shape;
+    result->strides = strides;
+    if(size<VECTOR_LAZY_SIZE) result->materialize();
+    return RESMOVE(Result(result));
+}
+
+Result Vector::reduce(int reduction) {
+    OwnedLock lock(this, memoryLock);
+    if(pending && !pendingUses++) return Result(pending->reduce(static_cast<VectorReduction>(reduction)));
+    materialize();
+    VectorReduction kind = static_cast<VectorReduction>(reduction);
+    int64_t chunks = (size+VECTOR_CHUNK-1)/VECTOR_CHUNK;
+    std::vector<double> partials(chunks);
+    int team = teamThreads();
+    #pragma omp parallel for schedule(static) num_threads(team) if(size>=VECTOR_PARALLEL_SIZE && team>1)
+    for(int64_t chunk=0;chunk<chunks;++chunk) {
+        uint64_t first = chunk*VECTOR_CHUNK;
+        int count = std::min<uint64_t>(size, first+VECTOR_CHUNK)-first;
+        const double* values = data+first*step;
+        if(step==1) {
+            partials[chunk] = accumulate(kind, values, count, kind==VEC_SUM?0:values[0]);
+            continue;
+        }
+        double tile[VECTOR_TILE];
+        double total = kind==VEC_SUM?0:values[0];
+        for(int start=0;start<count;start+=VECTOR_TILE) {
+            int tileCount = std::min(VECTOR_TILE, count-start);
+            for(int i=0;i<tileCount;++i) tile[i] = values[(start+i)*step];
+            total = accumulate(kind, tile, tileCount, total);
+        }
+        partials[chunk] = total;
+    }
+    return Result(combine(kind, partials.data(), chunks));
+}
 
 std::string Vector::toString(BMemory* memory){
-    std::lock_guard<std::recursive_mutex> lock(memoryLock);
+    OwnedLock lock(this, memoryLock);
+    materialize();
     std::string result("");
     for (std::size_t i = 0; i < std::min(static_cast<std::size_t>(size), static_cast<std::size_t>(10)); ++i) {
         if (result.size() > 1) result += ", ";
-        result += std::to_string(data[i]);
+        result += std::to_string(data[i*step]);
     }
     if (size > 10) result += ", ...";
     return result;
@@ -42,12 +405,15 @@ std::string Vector::toString(BMemory* memory){
 
 
 Result Vector::at(BMemory* memory, const DataPtr& other) {
-    std::lock_guard<std::recursive_mutex> lock(memoryLock);
     if (other.isint()) {
+        OwnedLock lock(this, memoryLock);
+        materialize();
         int64_t index = other.unsafe_toint();
         if (index < 0 || index >= size) return Result(OUT_OF_RANGE);
-        return RESMOVE(Result(data[index]));
+        return RESMOVE(Result(data[index*step]));
     }
+    std::lock_guard<std::recursive_mutex> lock(memoryLock); // iterables may run code that shares this vector
+    materialize();
 
     if (other.existsAndTypeEquals(LIST) || other.existsAndTypeEquals(ITERATOR)) {
         Result iter = other->iter(memory);
@@ -59,14 +425,18 @@ Result Vector::at(BMemory* memory, const DataPtr& other) {
             int64_t start = iterPtr->getStart();
             int64_t end = iterPtr->getEnd();
             if (start < 0 || end < 0 || start >= size || end > size) return Result(OUT_OF_RANGE);
-            auto* resultVec = new Vector(end - start);
-            if(start==0) for(int64_t i = start; i < end; ++i) resultVec->data[i] = data[i];
-            else for(int64_t i = start; i < end; ++i) resultVec->data[i - start] = data[i];
-            return Result(resultVec);
-        } 
+            return Result(new Vector(buffer, data + start*step, std::max<int64_t>(end - start, 0), step));
+        }
+        else if (iterPtr->isStrided()) {
+            int64_t start = iterPtr->getStart();
+            int64_t stride = iterPtr->getStep();
+            int64_t count = iterPtr->getEnd()>start?(iterPtr->getEnd() - start + stride - 1)/stride:0;
+            if (count && (start < 0 || start + (count-1)*stride >= size)) return Result(OUT_OF_RANGE);
+            return Result(new Vector(buffer, data + (count?start*step:0), count, step*stride));
+        }
         else {
-            auto* resultVec = new Vector(iterPtr->expectedSize());
-            int indexCount = 0;
+            std::vector<double> gathered;
+            gathered.reserve(std::max<int64_t>(iterPtr->expectedSize(), 0));
             while (true) {
                 Result next = iterator->next(memory);
                 DataPtr indexData = next.get();
@@ -74,8 +444,10 @@ Result Vector::at(BMemory* memory, const DataPtr& other) {
                 bbassert(indexData.isint(), "Iterable vector indexes can only contain integers.");
                 int64_t idx = indexData.unsafe_toint();
                 if (idx < 0 || idx >= size) return Result(OUT_OF_RANGE);
-                resultVec->data[indexCount++] = data[idx];
+                gathered.push_back(data[idx*step]);
             }
+            auto* resultVec = new Vector(gathered.size());
+            std::copy(gathered.begin(), gathered.end(), resultVec->data);
             return Result(resultVec);
         }
     }
@@ -90,9 +462,18 @@ Result Vector::put(BMemory* memory, const DataPtr& position, const DataPtr& valu
     else bberror("No builtin implementation for put(vector, "+value.torepr()+")");
 
     int64_t index = position.unsafe_toint();
-    std::lock_guard<std::recursive_mutex> lock(memoryLock);
+    OwnedLock lock(this, memoryLock);
     if (index < 0 || index >= size) return Result(OUT_OF_RANGE);
-    data[index] = val;
+    materialize();
+    if(buffer.use_count()>1) {
+        // pending expressions and views still read the current values
+        auto copied = std::shared_ptr<double[]>(new double[size]);
+        for(uint64_t i=0;i<size;++i) copied[i] = data[i*step];
+        buffer = copied;
+        data = buffer.get();
+        step = 1;
+    }
+    data[index*step] = val;
     return Result(DataPtr::NULLP);
 }
 
@@ -100,278 +481,157 @@ int64_t Vector::len(BMemory* memory) {return size;}
 Result Vector::iter(BMemory* memory) {return Result(new AccessIterator(this, size));}
 
 
-Result Vector::add(BMemory* memory, const DataPtr& other) {
-    if(other.isfloat() || other.isint()) {
-        double val = other.isfloat()?other.unsafe_tofloat():other.unsafe_toint();
-        std::lock_guard<std::recursive_mutex> lock(memoryLock);
-        Vector* result = new Vector(size);
-        #pragma omp simd
-        for (int i = 0; i < size; ++i) result->data[i] = data[i] + val;
-        return RESMOVE(Result(result));
-    }
-    bbassert(other.existsAndTypeEquals(VECTOR), "No builtin implementation for add(vector, "+other.torepr()+")");
-    Vector* vec = static_cast<Vector*>(other.get());
-    std::lock_guard<std::recursive_mutex> lock1(memoryLock);
-    std::lock_guard<std::recursive_mutex> lock2(vec->memoryLock);
-    Vector* result = new Vector(size);
-    #pragma omp simd
-    for (int i = 0; i < size; ++i) result->data[i] = data[i] + vec->data[i];
-    return RESMOVE(Result(result));
-}
-
-Result Vector::sub(BMemory* memory, const DataPtr& other) {
-    if(other.isfloat() || other.isint()) {
-        double val = other.isfloat()?other.unsafe_tofloat():other.unsafe_toint();
-        std::lock_guard<std::recursive_mutex> lock(memoryLock);
-        Vector* result = new Vector(size);
-        #pragma omp simd
-        for (int i = 0; i < size; ++i) result->data[i] = data[i] - val;
-        return RESMOVE(Result(result));
-    }
-    bbassert(other.existsAndTypeEquals(VECTOR), "No builtin implementation for sub(vector, "+other.torepr()+")");
-    Vector* vec = static_cast<Vector*>(other.get());
-    std::lock_guard<std::recursive_mutex> lock1(memoryLock);
-    std::lock_guard<std::recursive_mutex> lock2(vec->memoryLock);
-    Vector* result = new Vector(size);
-    #pragma omp simd
-    for (int i = 0; i < size; ++i) result->data[i] = data[i] - vec->data[i];
-    return RESMOVE(Result(result));
-}
+Result Vector::add(BMemory* memory, const DataPtr& other) {return elementwise(VEC_ADD, other, "add");}
+Result Vector::sub(BMemory* memory, const DataPtr& other) {return elementwise(VEC_SUB, other, "sub");}
+Result Vector::mul(BMemory* memory, const DataPtr& other) {return elementwise(VEC_MUL, other, "mul");}
+Result Vector::div(BMemory* memory, const DataPtr& other) {return elementwise(VEC_DIV, other, "div");}
+Result Vector::pow(BMemory* memory, const DataPtr& other) {return elementwise(VEC_POW, other, "pow");}
+Result Vector::lt(BMemory* memory, const DataPtr& other) {return elementwise(VEC_LT, other, "lt");}
+Result Vector::gt(BMemory* memory, const DataPtr& other) {return elementwise(VEC_GT, other, "gt");}
+Result Vector::le(BMemory* memory, const DataPtr& other) {return elementwise(VEC_LE, other, "le");}
+Result Vector::ge(BMemory* memory, const DataPtr& other) {return elementwise(VEC_GE, other, "ge");}
+Result Vector::eq(BMemory* memory, const DataPtr& other) {return elementwise(VEC_EQ, other, "eq");}
+Result Vector::neq(BMemory* memory, const DataPtr& other) {return elementwise(VEC_NEQ, other, "neq");}
+Result Vector::logarithm(BMemory* memory) {return elementwise(VEC_LOG, DataPtr::NULLP, "log");}
 
 Result Vector::rsub(BMemory* memory, const DataPtr& other) {
-    if(other.isfloat() || other.isint()) {
-        double val = other.isfloat()?other.unsafe_tofloat():other.unsafe_toint();
-        std::lock_guard<std::recursive_mutex> lock(memoryLock);
-        Vector* result = new Vector(size);
-        #pragma omp simd
-        for (int i = 0; i < size; ++i) result->data[i] =  val-data[i];
-        return RESMOVE(Result(result));
-    }
+    if(other.isfloat() || other.isint()) return elementwise(VEC_RSUB, other, "sub");
     return Data::rdiv(nullptr, other);
 }
 
-Result Vector::mul(BMemory* memory, const DataPtr& other) {
-    if(other.isfloat() || other.isint()) {
-        double val = other.isfloat()?other.unsafe_tofloat():other.unsafe_toint();
-        std::lock_guard<std::recursive_mutex> lock(memoryLock);
-        Vector* result = new Vector(size);
-        #pragma omp simd
-        for (int i = 0; i < size; ++i) result->data[i] = data[i] * val;
-        return RESMOVE(Result(result));
-    }
-    bbassert(other.existsAndTypeEquals(VECTOR), "No builtin implementation for mul(vector, "+other.torepr()+")");
-    Vector* vec = static_cast<Vector*>(other.get());
-    std::lock_guard<std::recursive_mutex> lock1(memoryLock);
-    std::lock_guard<std::recursive_mutex> lock2(vec->memoryLock);
-    Vector* result = new Vector(size);
-    #pragma omp simd
-    for (int i = 0; i < size; ++i) result->data[i] = data[i] * vec->data[i];
-    return RESMOVE(Result(result));
-}
-
-Result Vector::div(BMemory* memory, const DataPtr& other) {
-    if(other.isfloat() || other.isint()) {
-        double val = other.isfloat()?other.unsafe_tofloat():other.unsafe_toint();
-        std::lock_guard<std::recursive_mutex> lock(memoryLock);
-        Vector* result = new Vector(size);
-        #pragma omp simd
-        for (int i = 0; i < size; ++i) result->data[i] = data[i] / val;
-        return RESMOVE(Result(result));
-    }
-    bbassert(other.existsAndTypeEquals(VECTOR), "No builtin implementation for div(vector, "+other.torepr()+")");
-    Vector* vec = static_cast<Vector*>(other.get());
-    std::lock_guard<std::recursive_mutex> lock1(memoryLock);
-    std::lock_guard<std::recursive_mutex> lock2(vec->memoryLock);
-    Vector* result = new Vector(size);
-    #pragma omp simd
-    for (int i = 0; i < size; ++i) result->data[i] = data[i] / vec->data[i];
-    return RESMOVE(Result(result));
-}
-
 Result Vector::rdiv(BMemory* memory, const DataPtr& other) {
-    if(other.isfloat() || other.isint()) {
-        double val = other.isfloat()?other.unsafe_tofloat():other.unsafe_toint();
-        std::lock_guard<std::recursive_mutex> lock(memoryLock);
-        Vector* result = new Vector(size);
-        #pragma omp simd
-        for (int i = 0; i < size; ++i) result->data[i] = val/data[i];
-        return RESMOVE(Result(result));
-    }
+    if(other.isfloat() || other.isint()) return elementwise(VEC_RDIV, other, "div");
     return Data::rdiv(nullptr, other);
 }
 
-Result Vector::pow(BMemory* memory, const DataPtr& other) {
-    if(other.isfloat() || other.isint()) {
-        double val = other.isfloat()?other.unsafe_tofloat():other.unsafe_toint();
-        std::lock_guard<std::recursive_mutex> lock(memoryLock);
-        Vector* result = new Vector(size);
-        #pragma omp simd
-        for (int i = 0; i < size; ++i) result->data[i] = std::pow(data[i], val);
-        return RESMOVE(Result(result));
-    }
-    bbassert(other.existsAndTypeEquals(VECTOR), "No builtin implementation for pow(vector, "+other.torepr()+")");
-    Vector* vec = static_cast<Vector*>(other.get());
-    std::lock_guard<std::recursive_mutex> lock1(memoryLock);
-    std::lock_guard<std::recursive_mutex> lock2(vec->memoryLock);
-    Vector* result = new Vector(size);
-    #pragma omp simd
-    for (int i = 0; i < size; ++i) result->data[i] = std::pow(data[i], vec->data[i]);
-    return RESMOVE(Result(result));
-}
-
 Result Vector::rpow(BMemory* memory, const DataPtr& other) {
-    if(other.isfloat() || other.isint()) {
-        double val = other.isfloat()?other.unsafe_tofloat():other.unsafe_toint();
-        std::lock_guard<std::recursive_mutex> lock(memoryLock);
-        Vector* result = new Vector(size);
-        #pragma omp simd
-        for (int i = 0; i < size; ++i) result->data[i] =  std::pow(val, data[i]);
-        return RESMOVE(Result(result));
-    }
+    if(other.isfloat() || other.isint()) return elementwise(VEC_RPOW, other, "pow");
     return Data::rdiv(nullptr, other);
 }
 
-Result Vector::lt(BMemory* memory, const DataPtr& other) {
-    if(other.isfloat() || other.isint()) {
-        double val = other.isfloat()?other.unsafe_tofloat():other.unsafe_toint();
-        std::lock_guard<std::recursive_mutex> lock(memoryLock);
-        Vector* result = new Vector(size);
-        #pragma omp simd
-        for (int i = 0; i < size; ++i) result->data[i] = data[i] < val;
-        return RESMOVE(Result(result));
-    }
-    bbassert(other.existsAndTypeEquals(VECTOR), "No builtin implementation for lt(vector, "+other.torepr()+")");
-    Vector* vec = static_cast<Vector*>(other.get());
-    std::lock_guard<std::recursive_mutex> lock1(memoryLock);
-    std::lock_guard<std::recursive_mutex> lock2(vec->memoryLock);
-    Vector* result = new Vector(size);
-    #pragma omp simd
-    for (int i = 0; i < size; ++i) result->data[i] = data[i] < vec->data[i];
-    return RESMOVE(Result(result));
+Result Vector::sum(BMemory* memory) {return reduce(VEC_SUM);}
+
+Result Vector::min(BMemory* memory) {
+    if (size == 0) return Result(OUT_OF_RANGE);
+    return reduce(VEC_MIN);
 }
 
-Result Vector::gt(BMemory* memory, const DataPtr& other) {
-    if(other.isfloat() || other.isint()) {
-        double val = other.isfloat()?other.unsafe_tofloat():other.unsafe_toint();
-        std::lock_guard<std::recursive_mutex> lock(memoryLock);
-        Vector* result = new Vector(size);
-        #pragma omp simd
-        for (int i = 0; i < size; ++i) result->data[i] = data[i] > val;
-        return RESMOVE(Result(result));
-    }
-    bbassert(other.existsAndTypeEquals(VECTOR), "No builtin implementation for gt(vector, "+other.torepr()+")");
-    Vector* vec = static_cast<Vector*>(other.get());
-    std::lock_guard<std::recursive_mutex> lock1(memoryLock);
-    std::lock_guard<std::recursive_mutex> lock2(vec->memoryLock);
-    Vector* result = new Vector(size);
-    #pragma omp simd
-    for (int i = 0; i < size; ++i) result->data[i] = data[i] > vec->data[i];
-    return RESMOVE(Result(result));
+Result Vector::max(BMemory* memory) {
+    if (size == 0) return Result(OUT_OF_RANGE);
+    return reduce(VEC_MAX);
 }
 
-Result Vector::le(BMemory* memory, const DataPtr& other) {
-    if(other.isfloat() || other.isint()) {
-        double val = other.isfloat()?other.unsafe_tofloat():other.unsafe_toint();
-        std::lock_guard<std::recursive_mutex> lock(memoryLock);
-        Vector* result = new Vector(size);
-        #pragma omp simd
-        for (int i = 0; i < size; ++i) result->data[i] = data[i] <= val;
-        return RESMOVE(Result(result));
-    }
-    bbassert(other.existsAndTypeEquals(VECTOR), "No builtin implementation for le(vector, "+other.torepr()+")");
-    Vector* vec = static_cast<Vector*>(other.get());
-    std::lock_guard<std::recursive_mutex> lock1(memoryLock);
-    std::lock_guard<std::recursive_mutex> lock2(vec->memoryLock);
-    Vector* result = new Vector(size);
-    #pragma omp simd
-    for (int i = 0; i < size; ++i) result->data[i] = data[i] <= vec->data[i];
-    return RESMOVE(Result(result));
+Result Vector::getShape(BMemory* memory) {
+    OwnedLock lock(this, memoryLock);
+    BList* dims = new BList(shape.size());
+    for(int64_t dim : shape) dims->contents.emplace_back(dim);
+    return Result(dims);
 }
 
-Result Vector::ge(BMemory* memory, const DataPtr& other) {
-    if(other.isfloat() || other.isint()) {
-        double val = other.isfloat()?other.unsafe_tofloat():other.unsafe_toint();
-        std::lock_guard<std::recursive_mutex> lock(memoryLock);
-        Vector* result = new Vector(size);
-        #pragma omp simd
-        for (int i = 0; i < size; ++i) result->data[i] = data[i] >= val;
-        return RESMOVE(Result(result));
+Result Vector::reshape(BMemory* memory, const std::vector<int64_t>& dims) {
+    OwnedLock lock(this, memoryLock);
+    int64_t elements = 1;
+    std::string description;
+    for(int64_t dim : dims) {
+        bbassert(dim>0, "Vector dimensions must be positive but "+std::to_string(dim)+" was given");
+        elements *= dim;
+        description += (description.size()?"x":"")+std::to_string(dim);
     }
-    bbassert(other.existsAndTypeEquals(VECTOR), "No builtin implementation for ge(vector, "+other.torepr()+")");
-    Vector* vec = static_cast<Vector*>(other.get());
-    std::lock_guard<std::recursive_mutex> lock1(memoryLock);
-    std::lock_guard<std::recursive_mutex> lock2(vec->memoryLock);
-    Vector* result = new Vector(size);
-    #pragma omp simd
-    for (int i = 0; i < size; ++i) result->data[i] = data[i] >= vec->data[i];
-    return RESMOVE(Result(result));
+    bbassert(elements==size, "Cannot reshape a vector of "+std::to_string(size)+" elements to "+description);
+    materialize(); // reshaped views read the buffer, which compact() leaves unset for pending results
+    compact();
+    return Result(new Vector(buffer, data, dims));
 }
 
-Result Vector::eq(BMemory* memory, const DataPtr& other) {
-    if(other.isfloat() || other.isint()) {
-        double val = other.isfloat()?other.unsafe_tofloat():other.unsafe_toint();
-        std::lock_guard<std::recursive_mutex> lock(memoryLock);
-        Vector* result = new Vector(size);
-        #pragma omp simd
-        for (int i = 0; i < size; ++i) result->data[i] = data[i] == val;
-        return RESMOVE(Result(result));
+#ifdef BLOMBLY_USE_BLAS
+extern "C" void cblas_dgemm(int order, int transA, int transB, int m, int n, int k, double alpha, 
+                            const double* A, int lda, const double* B, int ldb, double beta, double* C, int ldc);
+#endif
+
+#define GEMM_BLOCK_ROWS 64
+#define GEMM_BLOCK_DEPTH 256
+#define GEMM_BLOCK_COLS 1024
+#define GEMM_PARALLEL_WORK 1000000 // multiply-adds below which parallelization costs more than it saves
+
+// C = A B for row-major A (m x k), B (k x n), and C (m x n) whose rows start every lda, ldb, and ldc elements.
+// Blocks of B are kept in cache while they are applied to all rows of A, and four rows of C are updated 
+// together so that each loaded row of B is reused from registers.
+static void gemm(int64_t m, int64_t n, int64_t k, const double* A, int64_t lda, const double* B, int64_t ldb, double* C, int64_t ldc) {
+    #ifdef BLOMBLY_USE_BLAS
+    cblas_dgemm(101, 111, 111, m, n, k, 1.0, A, lda, B, ldb, 0.0, C, ldc); // row-major, no transpositions
+    #else
+    for(int64_t i=0;i<m;++i) std::fill(C+i*ldc, C+i*ldc+n, 0.0);
+    int team = teamThreads();
+    bool parallel = m*n*k>=GEMM_PARALLEL_WORK && team>1;
+    for(int64_t jj=0;jj<n;jj+=GEMM_BLOCK_COLS) {
+        int64_t jend = std::min(n, jj+GEMM_BLOCK_COLS);
+        for(int64_t pp=0;pp<k;pp+=GEMM_BLOCK_DEPTH) {
+            int64_t pend = std::min(k, pp+GEMM_BLOCK_DEPTH);
+            #pragma omp parallel for schedule(static) num_threads(team) if(parallel)
+            for(int64_t ii=0;ii<m;ii+=GEMM_BLOCK_ROWS) {
+                int64_t iend = std::min(m, ii+GEMM_BLOCK_ROWS);
+                int64_t i = ii;
+                for(;i+4<=iend;i+=4) {
+                    double* c0 = C+i*ldc;
+                    double* c1 = c0+ldc;
+                    double* c2 = c1+ldc;
+                    double* c3 = c2+ldc;
+                    for(int64_t p=pp;p<pend;++p) {
+                        double a0 = A[i*lda+p];
+                        double a1 = A[(i+1)*lda+p];
+                        double a2 = A[(i+2)*lda+p];
+                        double a3 = A[(i+3)*lda+p];
+                        const double* b = B+p*ldb;
+                        #pragma omp simd
+                        for(int64_t j=jj;j<jend;++j) {
+                            double bj = b[j];
+                            c0[j] += a0*bj;
+                            c1[j] += a1*bj;
+                            c2[j] += a2*bj;
+                            c3[j] += a3*bj;
+                        }
+                    }
+                }
+                for(;i<iend;++i) {
+                    double* c = C+i*ldc;
+                    for(int64_t p=pp;p<pend;++p) {
+                        double a = A[i*lda+p];
+                        const double* b = B+p*ldb;
+                        #pragma omp simd
+                        for(int64_t j=jj;j<jend;++j) c[j] += a*b[j];
+                    }
+                }
+            }
+        }
     }
-    bbassert(other.existsAndTypeEquals(VECTOR), "No builtin implementation for eq(vector, "+other.torepr()+")");
-    Vector* vec = static_cast<Vector*>(other.get());
-    std::lock_guard<std::recursive_mutex> lock1(memoryLock);
-    std::lock_guard<std::recursive_mutex> lock2(vec->memoryLock);
-    Vector* result = new Vector(size);
-    #pragma omp simd
-    for (int i = 0; i < size; ++i) result->data[i] = data[i] == vec->data[i];
-    return RESMOVE(Result(result));
+    #endif
 }
 
-Result Vector::neq(BMemory* memory, const DataPtr& other) {
-    if(other.isfloat() || other.isint()) {
-        double val = other.isfloat()?other.unsafe_tofloat():other.unsafe_toint();
-        std::lock_guard<std::recursive_mutex> lock(memoryLock);
-        Vector* result = new Vector(size);
-        #pragma omp simd
-        for (int i = 0; i < size; ++i) result->data[i] = data[i] != val;
-        return RESMOVE(Result(result));
-    }
-    bbassert(other.existsAndTypeEquals(VECTOR), "No builtin implementation for neq(vector, "+other.torepr()+")");
+Result Vector::mmul(BMemory* memory, const DataPtr& other) {
+    bbassert(other.existsAndTypeEquals(VECTOR), "No builtin implementation for mmul(vector, "+other.torepr()+")");
     Vector* vec = static_cast<Vector*>(other.get());
-    std::lock_guard<std::recursive_mutex> lock1(memoryLock);
-    std::lock_guard<std::recursive_mutex> lock2(vec->memoryLock);
-    Vector* result = new Vector(size);
-    #pragma omp simd
-    for (int i = 0; i < size; ++i) result->data[i] = data[i] != vec->data[i];
+    OwnedLock lock1(this, memoryLock);
+    OwnedLock lock2(vec, vec->memoryLock);
+    bbassert(shape.size()<=2 && vec->shape.size()<=2, "mmul is only implemented between vectors and matrices");
+    materialize();
+    vec->materialize();
+    compact();
+    vec->compact();
+    // one-dimensional vectors are rows on the left and columns on the right, and that dimension is then dropped
+    int64_t m = shape.size()==2?shape[0]:1;
+    int64_t k = shape.back();
+    int64_t n = vec->shape.size()==2?vec->shape[1]:1;
+    if(vec->shape[0]!=k) return Result(INCOMPATIBLE_SIZES);
+    if(shape.size()==1 && vec->shape.size()==1) {
+        double total = 0;
+        for(int64_t p=0;p<k;++p) total += data[p]*vec->data[p];
+        return Result(total);
+    }
+    std::vector<int64_t> dims;
+    if(shape.size()==2) dims.push_back(m);
+    if(vec->shape.size()==2) dims.push_back(n);
+    auto product = std::shared_ptr<double[]>(new double[m*n]);
+    Vector* result = new Vector(product, product.get(), dims);
+    gemm(m, n, k, data, shape.size()==2?strides[0]:k, vec->data, vec->shape.size()==2?vec->strides[0]:1, result->data, n);
     return RESMOVE(Result(result));
 }
-
-Result Vector::sum(BMemory* memory) {
-    std::lock_guard<std::recursive_mutex> lock(memoryLock);
-    double total = 0;
-    for (int i = 0; i < size; ++i) total += data[i];
-    return Result(total);
-}
-
-Result Vector::min(BMemory* memory) {
-    if (size == 0) return Result(OUT_OF_RANGE);
-    std::lock_guard<std::recursive_mutex> lock(memoryLock);
-    double minValue = data[0];
-    for (int i = 1; i < size; ++i) if (data[i] < minValue) minValue = data[i];
-    return Result(minValue);
-}
-
-Result Vector::max(BMemory* memory) {
-    std::lock_guard<std::recursive_mutex> lock(memoryLock);
-    if (size == 0) return Result(OUT_OF_RANGE);
-    double maxValue = data[0];
-    for (int i = 1; i < size; ++i) if (data[i] > maxValue) maxValue = data[i];
-    return Result(maxValue);
-}
-
-Result Vector::logarithm(BMemory* memory) {
-    std::lock_guard<std::recursive_mutex> lock(memoryLock);
-    auto* result = new Vector(size);
-    #pragma omp simd
-    for (int i = 0; i < size; ++i) result->data[i] = std::log(data[i]);
-    return Result(result);
-}
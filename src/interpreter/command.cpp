@@ -25,6 +25,7 @@
 #include <string>
 #include <sstream>
 #include <iomanip>
+#include <algorithm>
 
 void replaceAll(std::string &str, const std::string &from, const std::string &to) {
     size_t start_pos = 0;
@@ -42,10 +43,50 @@ SourceFile::SourceFile(const std::string& path) : path(path) {}
 // CommandContext constructor
 CommandContext::CommandContext(const std::string& source) : source(source) {}
 
-// Command constructor
-Command::Command(const std::string& command, const std::shared_ptr<SourceFile>& source_, int line_, const std::shared_ptr<CommandContext>& descriptor_) 
-    : source((source_)), line(line_), descriptor((descriptor_)), value(DataPtr::NULLP) {
-    args.reserve(4); // small object optimization (also multiple of 2 for good alignment
+CommandArgs::CommandArgs(const CommandArgs& other) : overflow(nullptr), count(other.count) {
+    std::copy(other.inlined, other.inlined+COMMAND_INLINE_ARGS, inlined);
+    if(other.overflow) {
+        overflow = new int[count-COMMAND_INLINE_ARGS];
+        std::copy(other.overflow, other.overflow+count-COMMAND_INLINE_ARGS, overflow);
+    }
+}
+
+CommandArgs::CommandArgs(CommandArgs&& other) noexcept : overflow(other.overflow), count(other.count) {
+    std::copy(other.inlined, other.inlined+COMMAND_INLINE_ARGS, inlined);
+    other.overflow = nullptr;
+    other.count = 0;
+}
+
+CommandArgs& CommandArgs::operator=(const CommandArgs& other) {
+    if(this==&other) return *this;
+    CommandArgs copied(other);
+    *this = std::move(copied);
+    return *this;
+}
+
+CommandArgs& CommandArgs::operator=(CommandArgs&& other) noexcept {
+    if(this==&other) return *this;
+    delete[] overflow;
+    overflow = other.overflow;
+    count = other.count;
+    std::copy(other.inlined, other.inlined+COMMAND_INLINE_ARGS, inlined);
+    other.overflow = nullptr;
+    other.count = 0;
+    return *this;
+}
+
+void CommandArgs::assign(const std::vector<int>& values) {
+    delete[] overflow;
+    overflow = nullptr;
+    count = values.size();
+    for(int i=0;i<count && i<COMMAND_INLINE_ARGS;++i) inlined[i] = values[i];
+    if(count>COMMAND_INLINE_ARGS) {
+        overflow = new int[count-COMMAND_INLINE_ARGS];
+        std::copy(values.begin()+COMMAND_INLINE_ARGS, values.end(), overflow);
+    }
+}
+
+std::vector<std::string> Command::split(const std::string& command) {
     std::vector<std::string> argNames;
     argNames.reserve(4);
     std::string accumulate;
@@ -67,40 +108,61 @@ Command::Command(const std::string& command, const std::shared_ptr<SourceFile>&
         else accumulate += command[pos];
         pos += 1;
     }
+    return argNames;
+}
+
+DataPtr Command::parseBuiltin(std::string raw) {
+    bbassert(raw.size()>=1, "There is no second argument provided to the `BUILTIN`");
+    if (raw[0] == '"') {
+        raw = raw.substr(1, raw.size() - 2);
+        raw = toUnicodeAndAnsi(raw);
+        return BString::intern(raw);
+    }
+    if (raw[0] == 'I') return DataPtr((int64_t)std::atoi(raw.substr(1).c_str()));//new Integer(std::atoi(raw.substr(1).c_str()));}
+    if (raw[0] == 'F') return DataPtr((double)std::atof(raw.substr(1).c_str()));//new BFloat(std::atof(raw.substr(1).c_str()));
+    if (raw[0] == 'B') return DataPtr((raw == "Btrue")?true:false);//(raw == "Btrue")?Boolean::valueTrue:Boolean::valueFalse;
+    bberror("Unable to understand builtin value prefix (should be one of I,F,B,\"): " + raw);
+}
+
+// Command constructor
+Command::Command(const std::string& command, const std::shared_ptr<SourceFile>& source_, int line_, const std::shared_ptr<CommandContext>& descriptor_, CommandDebugTable& debugTable) 
+    : deoptimized(false), debugInfo(debugTable.add(source_, line_, descriptor_)), value(DataPtr::NULLP) {
+    std::vector<std::string> argNames = split(command);
 
     operation = getOperationType(argNames[0]);
-    nargs = argNames.size() - 1;
+    int nargs = argNames.size() - 1;
 
     if (operation == BUILTIN) {
         nargs -= 1;
         bbassert(argNames.size()>=3, "There is no second argument provided to the `BUILTIN`");
-        std::string raw = argNames[2];
-        bbassert(raw.size()>=1, "There is no second argument provided to the `BUILTIN`");
-        if (raw[0] == '"') {
-            raw = raw.substr(1, raw.size() - 2);
-            raw = toUnicodeAndAnsi(raw);
-            value = new BString(raw);
-        }
-        else if (raw[0] == 'I') value = DataPtr((int64_t)std::atoi(raw.substr(1).c_str()));//new Integer(std::atoi(raw.substr(1).c_str()));}
-        else if (raw[0] == 'F') value = DataPtr((double)std::atof(raw.substr(1).c_str()));//new BFloat(std::atof(raw.substr(1).c_str()));
-        else if (raw[0] == 'B') value = DataPtr((raw == "Btrue")?true:false);//(raw == "Btrue")?Boolean::valueTrue:Boolean::valueFalse;
-        else bberror("Unable to understand builtin value prefix (should be one of I,F,B,\"): " + raw);
+        value = parseBuiltin(argNames[2]);
         value.existsAddOwner();
+        value.existsShare(); // constants are reached by every thread running the program
     }
 
     // Initialize args and knownLocal vectors
-    args.reserve(nargs);
+    std::vector<int> argIds;
+    argIds.reserve(nargs);
     //knownLocal.reserve(nargs);
     for (int i = 0; i < nargs; ++i) {
         //knownLocal.push_back(argNames[i + 1].size()>=3 && argNames[i + 1].substr(0, 3) == "_bb" && (argNames[i + 1].size()<=8 || argNames[i + 1].substr(0, 8) != "_bbmacro"));
-        args.push_back(variableManager.getId(argNames[i + 1]));
+        argIds.push_back(variableManager.getId(argNames[i + 1]));
     }
+    args.assign(argIds);
     bbassert(args.size() == 0 || argNames.size() == 0 || args[0] != variableManager.thisId || argNames[0] == "set" || argNames[0] == "setfinal" || argNames[0] == "get" || argNames[0] == "return",
         "Cannot assign to `this`."
         "\n    Encountered for operation: " + argNames[0] +
         "\n    This error appears only when you use `this` as a method argument or for invalid hand-written .bbvm files.");
 }
 
+// constructor for already validated instructions, such as those of binary .bbvm files
+Command::Command(OperationType operation, const std::vector<int>& argIds, const DataPtr& value, const std::shared_ptr<SourceFile>& source_, int line_, const std::shared_ptr<CommandContext>& descriptor_, CommandDebugTable& debugTable) 
+    : operation(operation), deoptimized(false), debugInfo(debugTable.add(source_, line_, descriptor_)), value(value) {
+    args.assign(argIds);
+    this->value.existsAddOwner();
+    this->value.existsShare(); // constants are reached by every thread running the program
+}
+
 Command::~Command() {}
 
 std::string Command::toString() const {
@@ -25,13 +25,14 @@ std::string getStackFrame(const Command& command) {
     std::string comm = command.toString();
     std::string message("");
     comm.resize(40, ' ');
-    if(command.descriptor) {
-        size_t idx = command.descriptor->source.find("//");
-        if(idx==std::string::npos || idx>=command.descriptor->source.size()-2) message += std::string("  \x1B[34m\u2192\033[0m ") + "\x1B[90m" + command.descriptor->source;
+    CommandDebugInfo info = command.debug();
+    if(info.descriptor) {
+        size_t idx = info.descriptor->source.find("//");
+        if(idx==std::string::npos || idx>=info.descriptor->source.size()-2) message += std::string("  \x1B[34m\u2192\033[0m ") + "\x1B[90m" + info.descriptor->source;
         else {
-            std::string sourceCode = command.descriptor->source.substr(0, idx);
+            std::string sourceCode = info.descriptor->source.substr(0, idx);
             sourceCode.resize(42, ' ');
-            message += std::string("  \x1B[34m\u2192\033[0m ") + sourceCode + " \t\x1B[90m "+command.descriptor->source.substr(idx+2);
+            message += std::string("  \x1B[34m\u2192\033[0m ") + sourceCode + " \t\x1B[90m "+info.descriptor->source.substr(idx+2);
         }
     }
     return std::move(message);
@@ -40,16 +41,17 @@ std::string getStackFrame(const Command& command) {
 std::string enrichErrorDescription(const Command& command, std::string message) {
     std::string comm = command.toString();
     comm.resize(40, ' ');
-    if(command.descriptor) {
-        size_t idx = command.descriptor->source.find("//");
-        if(idx==std::string::npos || idx>=command.descriptor->source.size()-2) message += std::string("\n   \x1B[34m\u2192\033[0m ") + "\x1B[90m" + command.descriptor->source;
+    CommandDebugInfo info = command.debug();
+    if(info.descriptor) {
+        size_t idx = info.descriptor->source.find("//");
+        if(idx==std::string::npos || idx>=info.descriptor->source.size()-2) message += std::string("\n   \x1B[34m\u2192\033[0m ") + "\x1B[90m" + info.descriptor->source;
         else {
-            std::string sourceCode = command.descriptor->source.substr(0, idx);
+            std::string sourceCode = info.descriptor->source.substr(0, idx);
             sourceCode.resize(42, ' ');
-            message += std::string("\n  \x1B[34m\u2192\033[0m ") + sourceCode + " \t\x1B[90m "+command.descriptor->source.substr(idx+2);
+            message += std::string("\n  \x1B[34m\u2192\033[0m ") + sourceCode + " \t\x1B[90m "+info.descriptor->source.substr(idx+2);
         }
     }
-    else message += std::string("\n  \x1B[34m\u2192\033[0m ") + comm + " \t\x1B[90m " + command.source->path + " line " + std::to_string(command.line);
+    else message += std::string("\n  \x1B[34m\u2192\033[0m ") + comm + " \t\x1B[90m " + info.source->path + " line " + std::to_string(info.line);
     return std::move(message);
 }
 
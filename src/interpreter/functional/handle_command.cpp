@@ -37,6 +37,7 @@
 #include "interpreter/Command.h"
 #include "interpreter/functional.h"
 #include "interpreter/thread.h"
+#include "interpreter/ThreadPool.h"
 #include "math.h"
 
 extern BError* NO_TRY_INTERCEPT;
@@ -55,6 +56,111 @@ extern BError* OUT_OF_RANGE;
 #define DISPATCH_COMPUTED_RESULT {int carg = command.args[0]; if(carg!=variableManager.noneId) [[likely]] memory.set(carg, result); continue;}
 #define RUN_IF_RETURN(expr) {if (expr.returnSignal) [[unlikely]] {memory.runFinally();return expr;} continue;}
 
+#define RUN_BRANCH(ifCommand, condition) { \
+        if(condition) { \
+            const auto& accept = memory.get(ifCommand.args[2]); \
+            if(accept.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(accept.get())->consume()->toString(nullptr)); \
+            if(accept.existsAndTypeEquals(CODE)) { \
+                Code* code = static_cast<Code*>(accept.get()); \
+                auto returnedValue = run(program, code->getStart(), code->getOptimizedEnd()); \
+                RUN_IF_RETURN(returnedValue); \
+            } \
+            else bberrorexplain("Unexpected value: "+accept.torepr(), "If body can only be a code block. Did you mean to return from it?", ""); \
+        } \
+        else if(ifCommand.args.size()>3) { \
+            const auto& reject = memory.get(ifCommand.args[3]); \
+            if(reject.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(reject.get())->consume()->toString(nullptr)); \
+            if (reject.existsAndTypeEquals(CODE)) { \
+                Code* code = static_cast<Code*>(reject.get()); \
+                auto returnedValue = run(program, code->getStart(), code->getOptimizedEnd()); \
+                RUN_IF_RETURN(returnedValue); \
+            } \
+            else bberrorexplain("Unexpected value: "+reject.torepr(), "Else body can only be a code block. Did you mean to return from it?", ""); \
+        } \
+        continue; \
+    }
+
+// Superinstructions span the current command and the next one, which stays in place (see fuseSuperinstructions in vm.cpp).
+// Their fast paths skip the next command and never store the intermediate value, which nothing else reads. Otherwise, they
+// fall back to running the two commands separately. Operands of the next command are read after advancing to it, so that 
+// errors are attributed to the command that would have raised them.
+#define FUSED_NUMERIC(OP, setter) \
+        if(arg0.isintint(arg1)) setter(arg0.unsafe_toint() OP arg1.unsafe_toint()); \
+        if(arg0.isfloatfloat(arg1)) setter(arg0.unsafe_tofloat() OP arg1.unsafe_tofloat()); \
+        if(arg0.isint() && arg1.isfloat()) setter(arg0.unsafe_toint() OP arg1.unsafe_tofloat()); \
+        if(arg0.isfloat() && arg1.isint()) setter(arg0.unsafe_tofloat() OP arg1.unsafe_toint());
+#define FUSED_DISPATCH_LITERAL(expr) {int carg = program[i].args[0]; result=DataPtr(expr); if(carg!=variableManager.noneId) [[likely]] memory.unsafeSetLiteral(carg, result); continue;}
+#define FUSED_LITERAL_OPERATION(OP) { \
+        int intermediate = command.args[0]; \
+        const Command& next = program[++i]; \
+        arg0 = next.args[1]==intermediate?command.value:memory.get(next.args[1]); \
+        arg1 = next.args[2]==intermediate?command.value:memory.get(next.args[2]); \
+        FUSED_NUMERIC(OP, FUSED_DISPATCH_LITERAL) \
+        --i; \
+        goto DO_BUILTIN; \
+    }
+#define FUSED_ACCEPT(expr) {result = DataPtr(expr); goto FUSED_BRANCH;}
+#define FUSED_CONDITION(OP, boolean, FALLBACK) { \
+        arg0 = memory.get(command.args[1]); \
+        arg1 = memory.get(command.args[2]); \
+        FUSED_NUMERIC(OP, FUSED_ACCEPT) \
+        if(boolean) FUSED_ACCEPT(arg0.unsafe_tobool() OP arg1.unsafe_tobool()); \
+        goto FALLBACK; \
+    }
+
+// Quickened operations only check for the type they were specialized to and write the literal outcome directly. Any
+// other operands, or integer overflow, deoptimize the command and are handled by the generic operation from then on.
+static inline bool checkedAdd(int64_t a, int64_t b, int64_t& out) {
+    #ifndef _MSC_VER
+    return !__builtin_add_overflow(a, b, &out);
+    #else
+    if((b>0 && a>INT64_MAX-b) || (b<0 && a<INT64_MIN-b)) return false;
+    out = a+b;
+    return true;
+    #endif
+}
+static inline bool checkedSub(int64_t a, int64_t b, int64_t& out) {
+    #ifndef _MSC_VER
+    return !__builtin_sub_overflow(a, b, &out);
+    #else
+    if((b<0 && a>INT64_MAX+b) || (b>0 && a<INT64_MIN+b)) return false;
+    out = a-b;
+    return true;
+    #endif
+}
+static inline bool checkedMul(int64_t a, int64_t b, int64_t& out) {
+    #ifndef _MSC_VER
+    return !__builtin_mul_overflow(a, b, &out);
+    #else
+    if(a==0 || b==0) {out = 0; return true;}
+    if((a==-1 && b==INT64_MIN) || (b==-1 && a==INT64_MIN)) return false;
+    out = static_cast<int64_t>(static_cast<uint64_t>(a)*static_cast<uint64_t>(b));
+    return out/a==b;
+    #endif
+}
+#define QUICKENED_CHECKED(checked, GENERIC) { \
+        arg0 = memory.get(command.args[1]); \
+        arg1 = memory.get(command.args[2]); \
+        int64_t outcome; \
+        if(arg0.isintint(arg1) && checked(arg0.unsafe_toint(), arg1.unsafe_toint(), outcome)) [[likely]] DISPATCH_LITERAL(outcome); \
+        command.deoptimize(GENERIC); \
+        goto DO_##GENERIC; \
+    }
+#define QUICKENED_INT(OP, GENERIC) { \
+        arg0 = memory.get(command.args[1]); \
+        arg1 = memory.get(command.args[2]); \
+        if(arg0.isintint(arg1)) [[likely]] DISPATCH_LITERAL(arg0.unsafe_toint() OP arg1.unsafe_toint()); \
+        command.deoptimize(GENERIC); \
+        goto DO_##GENERIC; \
+    }
+#define QUICKENED_FLOAT(OP, GENERIC) { \
+        arg0 = memory.get(command.args[1]); \
+        arg1 = memory.get(command.args[2]); \
+        if(arg0.isfloatfloat(arg1)) [[likely]] DISPATCH_LITERAL(arg0.unsafe_tofloat() OP arg1.unsafe_tofloat()); \
+        command.deoptimize(GENERIC); \
+        goto DO_##GENERIC; \
+    }
+
 #define DISPATCH(OPERATION) goto *dispatch_table[OPERATION]
 void initialize_dispatch_table() {}
 
@@ -164,11 +270,44 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         &&DO_ZEROVECTOR,
         &&DO_ALLOCVECTOR,
         &&DO_LISTELEMENT,
-        &&DO_GATHER
+        &&DO_GATHER,
+        &&DO_STATS,
+        &&DO_BUILTIN_ADD,
+        &&DO_BUILTIN_SUB,
+        &&DO_BUILTIN_MUL,
+        &&DO_BUILTIN_LT,
+        &&DO_BUILTIN_LE,
+        &&DO_BUILTIN_GT,
+        &&DO_BUILTIN_GE,
+        &&DO_BUILTIN_EQ,
+        &&DO_BUILTIN_NEQ,
+        &&DO_LT_IF,
+        &&DO_LE_IF,
+        &&DO_GT_IF,
+        &&DO_GE_IF,
+        &&DO_EQ_IF,
+        &&DO_NEQ_IF,
+        &&DO_ADD_INT,
+        &&DO_SUB_INT,
+        &&DO_MUL_INT,
+        &&DO_LT_INT,
+        &&DO_LE_INT,
+        &&DO_GT_INT,
+        &&DO_GE_INT,
+        &&DO_EQ_INT,
+        &&DO_NEQ_INT,
+        &&DO_ADD_FLOAT,
+        &&DO_SUB_FLOAT,
+        &&DO_MUL_FLOAT,
+        &&DO_DIV_FLOAT,
+        &&DO_LT_FLOAT,
+        &&DO_LE_FLOAT,
+        &&DO_GT_FLOAT,
+        &&DO_GE_FLOAT
     };
-    DISPATCH(command.operation);
+    DISPATCH(command.dispatched());
     #else
-    switch (command.operation) {                                         \
+    switch (command.dispatched()) {                                         \
         case 0:  goto DO_NOT;                                    \
         case 1:  goto DO_AND;                                    \
         case 2:  goto DO_OR;                                     \
@@ -244,6 +383,39 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         case 72: goto DO_ALLOCVECTOR;                        \
         case 73: goto DO_LISTELEMENT;                        \
         case 74: goto DO_GATHER;                             \
+        case 75: goto DO_STATS;                              \
+        case 76: goto DO_BUILTIN_ADD;                        \
+        case 77: goto DO_BUILTIN_SUB;                        \
+        case 78: goto DO_BUILTIN_MUL;                        \
+        case 79: goto DO_BUILTIN_LT;                         \
+        case 80: goto DO_BUILTIN_LE;                         \
+        case 81: goto DO_BUILTIN_GT;                         \
+        case 82: goto DO_BUILTIN_GE;                         \
+        case 83: goto DO_BUILTIN_EQ;                         \
+        case 84: goto DO_BUILTIN_NEQ;                        \
+        case 85: goto DO_LT_IF;                              \
+        case 86: goto DO_LE_IF;                              \
+        case 87: goto DO_GT_IF;                              \
+        case 88: goto DO_GE_IF;                              \
+        case 89: goto DO_EQ_IF;                              \
+        case 90: goto DO_NEQ_IF;                             \
+        case 91: goto DO_ADD_INT;                            \
+        case 92: goto DO_SUB_INT;                            \
+        case 93: goto DO_MUL_INT;                            \
+        case 94: goto DO_LT_INT;                             \
+        case 95: goto DO_LE_INT;                             \
+        case 96: goto DO_GT_INT;                             \
+        case 97: goto DO_GE_INT;                             \
+        case 98: goto DO_EQ_INT;                             \
+        case 99: goto DO_NEQ_INT;                            \
+        case 100: goto DO_ADD_FLOAT;                          \
+        case 101: goto DO_SUB_FLOAT;                         \
+        case 102: goto DO_MUL_FLOAT;                         \
+        case 103: goto DO_DIV_FLOAT;                         \
+        case 104: goto DO_LT_FLOAT;                          \
+        case 105: goto DO_LE_FLOAT;                          \
+        case 106: goto DO_GT_FLOAT;                          \
+        case 107: goto DO_GE_FLOAT;                          \
         default: throw std::runtime_error("Invalid operation");  \
     }
     #endif
@@ -254,8 +426,8 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         int id2 = command.args[2];
         arg0 = memory.get(id1);
         arg1 = memory.get(id2);
-        if(arg0.isintint(arg1)) DISPATCH_LITERAL(arg0.unsafe_toint()+arg1.unsafe_toint());
-        if(arg0.isfloatfloat(arg1)) DISPATCH_LITERAL(arg0.unsafe_tofloat()+arg1.unsafe_tofloat());
+        if(arg0.isintint(arg1)) {command.quicken(ADD, ADD_INT); DISPATCH_LITERAL(arg0.unsafe_toint()+arg1.unsafe_toint());}
+        if(arg0.isfloatfloat(arg1)) {command.quicken(ADD, ADD_FLOAT); DISPATCH_LITERAL(arg0.unsafe_tofloat()+arg1.unsafe_tofloat());}
         if(arg0.isint() && arg1.isfloat()) DISPATCH_LITERAL((double)(arg0.unsafe_toint()+arg1.unsafe_tofloat()));
         if(arg0.isfloat() && arg1.isint()) DISPATCH_LITERAL((double)(arg0.unsafe_tofloat()+arg1.unsafe_toint()));
         if(arg0.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(arg0.get())->consume()->toString(nullptr));
@@ -269,8 +441,8 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         int id2 = command.args[2];
         arg0 = memory.get(id1);
         arg1 = memory.get(id2);
-        if(arg0.isintint(arg1)) DISPATCH_LITERAL(arg0.unsafe_toint()-arg1.unsafe_toint());
-        if(arg0.isfloatfloat(arg1)) DISPATCH_LITERAL(arg0.unsafe_tofloat()-arg1.unsafe_tofloat());
+        if(arg0.isintint(arg1)) {command.quicken(SUB, SUB_INT); DISPATCH_LITERAL(arg0.unsafe_toint()-arg1.unsafe_toint());}
+        if(arg0.isfloatfloat(arg1)) {command.quicken(SUB, SUB_FLOAT); DISPATCH_LITERAL(arg0.unsafe_tofloat()-arg1.unsafe_tofloat());}
         if(arg0.isint() && arg1.isfloat()) DISPATCH_LITERAL((double)(arg0.unsafe_toint()-arg1.unsafe_tofloat()));
         if(arg0.isfloat() && arg1.isint()) DISPATCH_LITERAL((double)(arg0.unsafe_tofloat()-arg1.unsafe_toint()));
         if(arg0.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(arg0.get())->consume()->toString(nullptr));
@@ -284,8 +456,8 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         int id2 = command.args[2];
         arg0 = memory.get(id1);
         arg1 = memory.get(id2);
-        if(arg0.isintint(arg1)) DISPATCH_LITERAL(arg0.unsafe_toint()*arg1.unsafe_toint());
-        if(arg0.isfloatfloat(arg1)) DISPATCH_LITERAL(arg0.unsafe_tofloat()*arg1.unsafe_tofloat());
+        if(arg0.isintint(arg1)) {command.quicken(MUL, MUL_INT); DISPATCH_LITERAL(arg0.unsafe_toint()*arg1.unsafe_toint());}
+        if(arg0.isfloatfloat(arg1)) {command.quicken(MUL, MUL_FLOAT); DISPATCH_LITERAL(arg0.unsafe_tofloat()*arg1.unsafe_tofloat());}
         if(arg0.isint() && arg1.isfloat()) DISPATCH_LITERAL((double)(arg0.unsafe_toint()*arg1.unsafe_tofloat()));
         if(arg0.isfloat() && arg1.isint()) DISPATCH_LITERAL((double)(arg0.unsafe_tofloat()*arg1.unsafe_toint()));
         if(arg0.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(arg0.get())->consume()->toString(nullptr));
@@ -300,7 +472,7 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         arg0 = memory.get(id1);
         arg1 = memory.get(id2);
         if(arg0.isintint(arg1)) DISPATCH_LITERAL(arg0.unsafe_toint()/(double)arg1.unsafe_toint());
-        if(arg0.isfloatfloat(arg1)) DISPATCH_LITERAL(arg0.unsafe_tofloat()/arg1.unsafe_tofloat());
+        if(arg0.isfloatfloat(arg1)) {command.quicken(DIV, DIV_FLOAT); DISPATCH_LITERAL(arg0.unsafe_tofloat()/arg1.unsafe_tofloat());}
         if(arg0.isint() && arg1.isfloat()) DISPATCH_LITERAL((double)(arg0.unsafe_toint()/arg1.unsafe_tofloat()));
         if(arg0.isfloat() && arg1.isint()) DISPATCH_LITERAL((double)(arg0.unsafe_tofloat()/arg1.unsafe_toint()));
         if(arg0.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(arg0.get())->consume()->toString(nullptr));
@@ -341,8 +513,8 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         int id2 = command.args[2];
         arg0 = memory.get(id1);
         arg1 = memory.get(id2);
-        if(arg0.isintint(arg1)) DISPATCH_LITERAL(arg0.unsafe_toint()<arg1.unsafe_toint());
-        if(arg0.isfloatfloat(arg1)) DISPATCH_LITERAL(arg0.unsafe_tofloat()<arg1.unsafe_tofloat());
+        if(arg0.isintint(arg1)) {command.quicken(LT, LT_INT); DISPATCH_LITERAL(arg0.unsafe_toint()<arg1.unsafe_toint());}
+        if(arg0.isfloatfloat(arg1)) {command.quicken(LT, LT_FLOAT); DISPATCH_LITERAL(arg0.unsafe_tofloat()<arg1.unsafe_tofloat());}
         if(arg0.isint() && arg1.isfloat()) DISPATCH_LITERAL(arg0.unsafe_toint()<arg1.unsafe_tofloat());
         if(arg0.isfloat() && arg1.isint()) DISPATCH_LITERAL(arg0.unsafe_tofloat()<arg1.unsafe_toint());
         if(arg0.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(arg0.get())->consume()->toString(nullptr));
@@ -356,8 +528,8 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         int id2 = command.args[2];
         arg0 = memory.get(id1);
         arg1 = memory.get(id2);
-        if(arg0.isintint(arg1)) DISPATCH_LITERAL(arg0.unsafe_toint()>arg1.unsafe_toint());
-        if(arg0.isfloatfloat(arg1)) DISPATCH_LITERAL(arg0.unsafe_tofloat()>arg1.unsafe_tofloat());
+        if(arg0.isintint(arg1)) {command.quicken(GT, GT_INT); DISPATCH_LITERAL(arg0.unsafe_toint()>arg1.unsafe_toint());}
+        if(arg0.isfloatfloat(arg1)) {command.quicken(GT, GT_FLOAT); DISPATCH_LITERAL(arg0.unsafe_tofloat()>arg1.unsafe_tofloat());}
         if(arg0.isint() && arg1.isfloat()) DISPATCH_LITERAL(arg0.unsafe_toint()>arg1.unsafe_tofloat());
         if(arg0.isfloat() && arg1.isint()) DISPATCH_LITERAL(arg0.unsafe_tofloat()>arg1.unsafe_toint());
         if(arg0.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(arg0.get())->consume()->toString(nullptr));
@@ -371,8 +543,8 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         int id2 = command.args[2];
         arg0 = memory.get(id1);
         arg1 = memory.get(id2);
-        if(arg0.isintint(arg1)) DISPATCH_LITERAL(arg0.unsafe_toint()<=arg1.unsafe_toint());
-        if(arg0.isfloatfloat(arg1)) DISPATCH_LITERAL(arg0.unsafe_tofloat()<=arg1.unsafe_tofloat());
+        if(arg0.isintint(arg1)) {command.quicken(LE, LE_INT); DISPATCH_LITERAL(arg0.unsafe_toint()<=arg1.unsafe_toint());}
+        if(arg0.isfloatfloat(arg1)) {command.quicken(LE, LE_FLOAT); DISPATCH_LITERAL(arg0.unsafe_tofloat()<=arg1.unsafe_tofloat());}
         if(arg0.isint() && arg1.isfloat()) DISPATCH_LITERAL(arg0.unsafe_toint()<=arg1.unsafe_tofloat());
         if(arg0.isfloat() && arg1.isint()) DISPATCH_LITERAL(arg0.unsafe_tofloat()<=arg1.unsafe_toint());
         if(arg0.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(arg0.get())->consume()->toString(nullptr));
@@ -386,8 +558,8 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         int id2 = command.args[2];
         arg0 = memory.get(id1);
         arg1 = memory.get(id2);
-        if(arg0.isintint(arg1)) DISPATCH_LITERAL(arg0.unsafe_toint()>=arg1.unsafe_toint());
-        if(arg0.isfloatfloat(arg1)) DISPATCH_LITERAL(arg0.unsafe_tofloat()>=arg1.unsafe_tofloat());
+        if(arg0.isintint(arg1)) {command.quicken(GE, GE_INT); DISPATCH_LITERAL(arg0.unsafe_toint()>=arg1.unsafe_toint());}
+        if(arg0.isfloatfloat(arg1)) {command.quicken(GE, GE_FLOAT); DISPATCH_LITERAL(arg0.unsafe_tofloat()>=arg1.unsafe_tofloat());}
         if(arg0.isint() && arg1.isfloat()) DISPATCH_LITERAL(arg0.unsafe_toint()>=arg1.unsafe_tofloat());
         if(arg0.isfloat() && arg1.isint()) DISPATCH_LITERAL(arg0.unsafe_tofloat()>=arg1.unsafe_toint());
         if(arg0.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(arg0.get())->consume()->toString(nullptr));
@@ -401,7 +573,7 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         int id2 = command.args[2];
         arg0 = memory.get(id1);
         arg1 = memory.get(id2);
-        if(arg0.isintint(arg1)) DISPATCH_LITERAL(arg0.unsafe_toint()==arg1.unsafe_toint());
+        if(arg0.isintint(arg1)) {command.quicken(EQ, EQ_INT); DISPATCH_LITERAL(arg0.unsafe_toint()==arg1.unsafe_toint());}
         if(arg0.isfloatfloat(arg1)) DISPATCH_LITERAL(arg0.unsafe_tofloat()==arg1.unsafe_tofloat());
         if(arg0.isint() && arg1.isfloat()) DISPATCH_LITERAL(arg0.unsafe_toint()==arg1.unsafe_tofloat());
         if(arg0.isfloat() && arg1.isint()) DISPATCH_LITERAL(arg0.unsafe_tofloat()==arg1.unsafe_toint());
@@ -417,7 +589,7 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         int id2 = command.args[2];
         arg0 = memory.get(id1);
         arg1 = memory.get(id2);
-        if(arg0.isintint(arg1)) DISPATCH_LITERAL(arg0.unsafe_toint()!=arg1.unsafe_toint());
+        if(arg0.isintint(arg1)) {command.quicken(NEQ, NEQ_INT); DISPATCH_LITERAL(arg0.unsafe_toint()!=arg1.unsafe_toint());}
         if(arg0.isfloatfloat(arg1)) DISPATCH_LITERAL(arg0.unsafe_tofloat()!=arg1.unsafe_tofloat());
         if(arg0.isint() && arg1.isfloat()) DISPATCH_LITERAL(arg0.unsafe_toint()!=arg1.unsafe_tofloat());
         if(arg0.isfloat() && arg1.isint()) DISPATCH_LITERAL(arg0.unsafe_tofloat()!=arg1.unsafe_toint());
@@ -501,7 +673,7 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         bberror("vector::alloc can only have an int size argument");
     }
     DO_LISTELEMENT: {
-        int n = command.nargs;
+        int n = command.args.size();
         auto list = new BList(n-1);
         for(int j=1;j<n;j++) {
             const DataPtr& element = memory.get(command.args[j]);
@@ -567,7 +739,7 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
     }
     DO_READ:{
         std::string printing;
-        if(command.nargs>1) {
+        if(command.args.size()>1) {
             int id1 = command.args[1];
             arg0 = memory.get(id1);
             if(arg0.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(arg0.get())->consume()->toString(nullptr));
@@ -623,6 +795,7 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         result = cachedData.getOrNullShallow(command.args[1]);
         command.value = result.get();
         command.value.existsAddOwner();
+        command.value.existsShare();
         bbassertexplain(result.islitorexists(), "Missing cache value:" + variableManager.getSymbol(command.args[1]), "Cache values are created by blombly's optimization. This message can appear only due to an internal error.", "");
         DISPATCH_COMPUTED_RESULT;
     }
@@ -647,11 +820,18 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
             if(arg0.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(arg0.get())->consume()->toString(nullptr));
         }
         auto structObj = static_cast<Struct*>(arg0.get());
-        std::lock_guard<std::recursive_mutex> lock(structObj->memoryLock);
+        OwnedLock lock(structObj, structObj->memoryLock);
         auto setValue = memory.get(command.args[3]);
         if(setValue.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(setValue.get())->consume()->toString(nullptr));
         if(setValue.existsAndTypeEquals(CODE)) setValue = static_cast<Code*>(setValue.get())->copy();
-        structObj->set(command.args[2], setValue);//structmemory.getOrNullShallow(command.args[2]));
+        const StructShape* shape = structObj->getShape();
+        int slot = command.fieldCache.lookup(shape->id);
+        if(slot<0) {
+            slot = shape->slot(command.args[2]);
+            if(slot>=0) command.fieldCache.store(shape->id, slot);
+        }
+        if(slot>=0) structObj->setAt(slot, setValue);
+        else structObj->set(command.args[2], setValue);//structmemory.getOrNullShallow(command.args[2]));
         result = nullptr;
         continue;
     }
@@ -674,13 +854,14 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         auto codeBody = static_cast<Code*>(arg1.get());
         auto codeCondition = static_cast<Code*>(arg0.get());
         Jitable* jitableCondition = codeCondition->jitable;
-        //Jitable* jitableBody = codeBody->jitable;
+        Jitable* jitableBody = codeBody->jitable;
         bool checkValue(true);
         int codeBodyStart = codeBody->getStart();
         int codeBodyEnd = codeBody->getOptimizedEnd();
         int codeConditionStart = codeCondition->getStart();
         int codeConditiionEnd = codeCondition->getOptimizedEnd();
         while(checkValue) {
+            if(jitableBody && jitableBody->runAsLoopBody(&memory, jitableCondition, forceStayInThread)) break;
             if(!jitableCondition || !jitableCondition->runWithBooleanIntent(&memory, checkValue, forceStayInThread)) {
                 auto returnedValue = run(program, codeConditionStart, codeConditiionEnd);
                 const auto& check = returnedValue.get();
@@ -693,11 +874,16 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
                 }
             }
             if(!checkValue) break;
-            /*if(jitableBody) {
-                bool shouldReturn;
-                jitableBody->run(&memory, result, shouldReturn, forceStayInThread);
-                continue;
-            }*/
+            if(jitableBody) {
+                bool shouldReturn(false);
+                if(jitableBody->run(&memory, result, shouldReturn, forceStayInThread)) {
+                    if(shouldReturn) [[unlikely]] {
+                        memory.runFinally();
+                        return ExecutionInstanceRunReturn(true, Result(result));
+                    }
+                    continue;
+                }
+            }
             auto returnedValueFromBody = run(program, codeBodyStart, codeBodyEnd);
             if(returnedValueFromBody.get().existsAndTypeEquals(ERRORTYPE)) throw BBError(returnedValueFromBody.get()->toString(nullptr));
             RUN_IF_RETURN(returnedValueFromBody);
@@ -709,29 +895,44 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         arg0 = memory.get(id1);
         if(arg0.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(arg0.get())->consume()->toString(nullptr));
         bbassertexplain(arg0.isbool(), "Unexpected value: "+arg0.torepr(), "If condition can only evaluate to bool.", "");
-
-        if(arg0.unsafe_tobool()) {
-            const auto& accept = memory.get(command.args[2]);
-            if(accept.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(accept.get())->consume()->toString(nullptr));
-            if(accept.existsAndTypeEquals(CODE)) {
-                Code* code = static_cast<Code*>(accept.get());
-                auto returnedValue = run(program, code->getStart(), code->getOptimizedEnd());
-                RUN_IF_RETURN(returnedValue);
-            }
-            else bberrorexplain("Unexpected value: "+accept.torepr(), "If body can only be a code block. Did you mean to return from it?", "");
-        } 
-        else if(command.nargs>3) {
-            const auto& reject = memory.get(command.args[3]);
-            if(reject.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(reject.get())->consume()->toString(nullptr));
-            if (reject.existsAndTypeEquals(CODE)) {
-                Code* code = static_cast<Code*>(reject.get());
-                auto returnedValue = run(program, code->getStart(), code->getOptimizedEnd());
-                RUN_IF_RETURN(returnedValue);
-            }
-            else bberrorexplain("Unexpected value: "+reject.torepr(), "Else body can only be a code block. Did you mean to return from it?", "");
-        }
-        continue;
-    }
+        RUN_BRANCH(command, arg0.unsafe_tobool());
+    }
+    DO_BUILTIN_ADD: FUSED_LITERAL_OPERATION(+);
+    DO_BUILTIN_SUB: FUSED_LITERAL_OPERATION(-);
+    DO_BUILTIN_MUL: FUSED_LITERAL_OPERATION(*);
+    DO_BUILTIN_LT: FUSED_LITERAL_OPERATION(<);
+    DO_BUILTIN_LE: FUSED_LITERAL_OPERATION(<=);
+    DO_BUILTIN_GT: FUSED_LITERAL_OPERATION(>);
+    DO_BUILTIN_GE: FUSED_LITERAL_OPERATION(>=);
+    DO_BUILTIN_EQ: FUSED_LITERAL_OPERATION(==);
+    DO_BUILTIN_NEQ: FUSED_LITERAL_OPERATION(!=);
+    DO_LT_IF: FUSED_CONDITION(<, false, DO_LT);
+    DO_LE_IF: FUSED_CONDITION(<=, false, DO_LE);
+    DO_GT_IF: FUSED_CONDITION(>, false, DO_GT);
+    DO_GE_IF: FUSED_CONDITION(>=, false, DO_GE);
+    DO_EQ_IF: FUSED_CONDITION(==, arg0.isbool() && arg1.isbool(), DO_EQ);
+    DO_NEQ_IF: FUSED_CONDITION(!=, arg0.isbool() && arg1.isbool(), DO_NEQ);
+    FUSED_BRANCH: {
+        ++i;
+        RUN_BRANCH(program[i], result.unsafe_tobool());
+    }
+    DO_ADD_INT: QUICKENED_CHECKED(checkedAdd, ADD);
+    DO_SUB_INT: QUICKENED_CHECKED(checkedSub, SUB);
+    DO_MUL_INT: QUICKENED_CHECKED(checkedMul, MUL);
+    DO_LT_INT: QUICKENED_INT(<, LT);
+    DO_LE_INT: QUICKENED_INT(<=, LE);
+    DO_GT_INT: QUICKENED_INT(>, GT);
+    DO_GE_INT: QUICKENED_INT(>=, GE);
+    DO_EQ_INT: QUICKENED_INT(==, EQ);
+    DO_NEQ_INT: QUICKENED_INT(!=, NEQ);
+    DO_ADD_FLOAT: QUICKENED_FLOAT(+, ADD);
+    DO_SUB_FLOAT: QUICKENED_FLOAT(-, SUB);
+    DO_MUL_FLOAT: QUICKENED_FLOAT(*, MUL);
+    DO_DIV_FLOAT: QUICKENED_FLOAT(/, DIV);
+    DO_LT_FLOAT: QUICKENED_FLOAT(<, LT);
+    DO_LE_FLOAT: QUICKENED_FLOAT(<=, LE);
+    DO_GT_FLOAT: QUICKENED_FLOAT(>, GT);
+    DO_GE_FLOAT: QUICKENED_FLOAT(>=, GE);
     DO_CREATESERVER: {
         const auto& port = memory.get(command.args[1]);
         if(port.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(port.get())->consume()->toString(nullptr));
@@ -763,7 +964,7 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
     DO_CATCH: {
         const auto& condition = memory.getOrNull(command.args[1], true); //(command.knownLocal[1]?memory.getOrNullShallow(command.args[1]):memory.getOrNull(command.args[1], true)); //memory.get(command.args[1]);
         const auto& accept = memory.get(command.args[2]);
-        const auto& reject = command.nargs>3?memory.get(command.args[3]):DataPtr::NULLP;
+        const auto& reject = command.args.size()>3?memory.get(command.args[3]):DataPtr::NULLP;
         if(accept.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(accept.get())->consume()->toString(nullptr));
         if(reject.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(reject.get())->consume()->toString(nullptr));
         bbassertexplain(accept.existsAndTypeEquals(CODE), "Unexpected value: "+accept.torepr(), "Can only inline a code block for catch acceptance.", "");
@@ -802,7 +1003,7 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         if(source.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(source.get())->consume()->toString(nullptr));
         bbassertexplain(source.existsAndTypeEquals(CODE), "Unexpected value: "+source.torepr(), "Can only call `default` on a code block.", "");
         auto code = static_cast<Code*>(source.get());
-        BMemory newMemory(depth, &memory, LOCAL_EXPECTATION_FROM_CODE(code));
+        BMemory newMemory(depth, &memory, LOCAL_EXPECTATION_FROM_CODE(code), code->layout);
         ExecutionInstance executor(depth, code, &newMemory, forceStayInThread);
         auto returnedValue = executor.run(code);
         if(returnedValue.returnSignal)  bberrorexplain("Unexpected command.", "Cannot return from within a `default` statement", "");
@@ -814,7 +1015,7 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         if(source.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(source.get())->consume()->toString(nullptr));
         bbassertexplain(source.existsAndTypeEquals(CODE), "Unexpected value: "+source.torepr(), "Can only create a new struct from a code block.", "");
         auto code = static_cast<Code*>(source.get());
-        BMemory newMemory(depth, &memory, LOCAL_EXPECTATION_FROM_CODE(code));
+        BMemory newMemory(depth, &memory, LOCAL_EXPECTATION_FROM_CODE(code), code->layout);
         auto thisObj = new Struct(); 
         newMemory.set(variableManager.thisId, thisObj);
         //newMemory->setFinal(variableManager.thisId);
@@ -870,7 +1071,7 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         DISPATCH_RESULT(ret);
     }
     DO_TOMAP: {
-        int n = command.nargs;
+        int n = command.args.size();
         if(n==1) DISPATCH_RESULT(new BHashMap());
         arg0 = memory.get(command.args[1]);
         if(arg0.existsAndTypeEquals(MAP)) DISPATCH_RESULT(arg0);
@@ -882,8 +1083,16 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         result = DataPtr(wallclock_start+static_cast<double>(std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now()-program_start).count()));
         DISPATCH_COMPUTED_RESULT;
     }
+    DO_STATS: {
+        // runtime counters that let tests check that optimizations actually take place
+        BHashMap* stats = new BHashMap();
+        stats->fastUnsafePut(DataPtr(new BString("threads")), DataPtr(static_cast<int64_t>(threadPool.size()+1)));
+        stats->fastUnsafePut(DataPtr(new BString("calls::pooled")), DataPtr(static_cast<int64_t>(threadPool.submitted())));
+        stats->fastUnsafePut(DataPtr(new BString("vectors::materialized")), DataPtr(static_cast<int64_t>(Vector::materializations())));
+        DISPATCH_RESULT(stats);
+    }
     DO_RANDOM: {
-        bbassertexplain(command.nargs>=0, "Expecting argument.", "Random requires at least one argument to serve as seed, such as the output of `time()`. There is no default to make sure that replicable tests can be created.", "");
+        bbassertexplain(command.args.size()>=0, "Expecting argument.", "Random requires at least one argument to serve as seed, such as the output of `time()`. There is no default to make sure that replicable tests can be created.", "");
         arg0 = memory.get(command.args[1]);
         if(arg0.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(arg0.get())->consume()->toString(nullptr));
         bbassertexplain(arg0.isfloat() || arg0.isint(), "Unexpected value: "+arg0.torepr(), "Random requires an int or float argument that serves as seed, such as the output of `time()`.", "");
@@ -987,7 +1196,21 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         arg0->clear(&memory);
         continue;
     }
-    DO_SHAPE: 
+    DO_SHAPE: {
+        arg0 = memory.get(command.args[1]);
+        if(arg0.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(arg0.get())->consume()->toString(nullptr));
+        bbassertexplain(arg0.existsAndTypeEquals(VECTOR), "Unexpected value: "+arg0.torepr(), "Only vectors have a shape.", "");
+        Vector* vec = static_cast<Vector*>(arg0.get());
+        if(command.args.size()==2) DISPATCH_OUTCOME(vec->getShape(&memory));
+        std::vector<int64_t> dims;
+        for(int j=2;j<command.args.size();++j) {
+            const auto& dim = memory.get(command.args[j]);
+            if(dim.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(dim.get())->consume()->toString(nullptr));
+            bbassertexplain(dim.isint(), "Unexpected value: "+dim.torepr(), "Vector dimensions can only be integers.", "");
+            dims.push_back(dim.unsafe_toint());
+        }
+        DISPATCH_OUTCOME(vec->reshape(&memory, dims));
+    }
     DO_TOFILE: {
         arg0 = memory.get(command.args[1]);
         if(arg0.existsAndTypeEquals(FILETYPE)) DISPATCH_RESULT(arg0);
@@ -1009,17 +1232,17 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         DISPATCH_OUTCOME(arg0->iter(&memory));
     }
     DO_TORANGE: {
-        bbassertexplain(command.nargs>=0, "Expecting arguments.", "Range requires at least one argument.", "");
+        bbassertexplain(command.args.size()>=0, "Expecting arguments.", "Range requires at least one argument.", "");
         arg0 = memory.get(command.args[1]);
         if(arg0.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(arg0.get())->consume()->toString(nullptr));
-        if(command.nargs<=2 && arg0.isint()) DISPATCH_RESULT(new IntRange(0, arg0.unsafe_toint(), 1));
+        if(command.args.size()<=2 && arg0.isint()) DISPATCH_RESULT(new IntRange(0, arg0.unsafe_toint(), 1));
         arg1 = memory.get(command.args[2]);
         if(arg1.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(arg1.get())->consume()->toString(nullptr));
-        if(command.nargs<=3 && arg0.isintint(arg1)) DISPATCH_RESULT(new IntRange(arg0.unsafe_toint(), arg1.unsafe_toint(), 1));
+        if(command.args.size()<=3 && arg0.isintint(arg1)) DISPATCH_RESULT(new IntRange(arg0.unsafe_toint(), arg1.unsafe_toint(), 1));
         const auto& arg2 = memory.get(command.args[3]);
         if(arg2.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(arg2.get())->consume()->toString(nullptr));
-        if(command.nargs<=4 && arg0.isintint(arg1) && arg2.isint()) DISPATCH_RESULT(new IntRange(arg0.unsafe_toint(), arg1.unsafe_toint(), arg2.unsafe_toint()));
-        if(command.nargs<=4 && arg0.isfloatfloat(arg1) && arg2.isfloat()) DISPATCH_RESULT(new IntRange(arg0.unsafe_tofloat(), arg1.unsafe_tofloat(), arg2.unsafe_tofloat()));
+        if(command.args.size()<=4 && arg0.isintint(arg1) && arg2.isint()) DISPATCH_RESULT(new IntRange(arg0.unsafe_toint(), arg1.unsafe_toint(), arg2.unsafe_toint()));
+        if(command.args.size()<=4 && arg0.isfloatfloat(arg1) && arg2.isfloat()) DISPATCH_RESULT(new IntRange(arg0.unsafe_tofloat(), arg1.unsafe_tofloat(), arg2.unsafe_tofloat()));
         bberrorexplain("Unexpected arguments.", "Range can take as arguments up to three integers or exactly three floats.", "");
     }
     DO_GET: {
@@ -1032,8 +1255,14 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
             if(objFound.existsAndTypeEquals(ERRORTYPE)) throw BBError(static_cast<BError*>(objFound.get())->consume()->toString(nullptr));
             bbassertexplain(objFound.existsAndTypeEquals(STRUCT), "Unexpected value: "+objFound->toString(&memory), "Can only get fields from structs, but instead found this value.", "");
             auto obj = static_cast<Struct*>(objFound.get());
-            std::lock_guard<std::recursive_mutex> lock(obj->memoryLock);
-            result = obj->getOrNull(command.args[2]);
+            OwnedLock lock(obj, obj->memoryLock);
+            const StructShape* shape = obj->getShape();
+            int slot = command.fieldCache.lookup(shape->id);
+            if(slot<0) [[unlikely]] {
+                slot = shape->slot(command.args[2]);
+                if(slot>=0) command.fieldCache.store(shape->id, slot);
+            }
+            result = slot<0?DataPtr::NULLP:obj->getAt(slot);
             if(!result.islitorexists()) {
                 bbassertexplain(command.args[1]==variableManager.thisId, "Missing field: " + variableManager.getSymbol(command.args[2]), "The struct "+variableManager.getSymbol(command.args[1])+" does exist, but does not contain the field in question.", "");
                 result = memory.get(command.args[2]);
@@ -1061,6 +1290,7 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         ExecutionInstance cacheExecutor(depth, cache, &cacheMemory, forceStayInThread);
         auto ret = cacheExecutor.run(cache);
         cacheMemory.await();
+        cachedData.markShared(); // cached values are read by all threads
         cachedData.pull(&cacheMemory);
         result = nullptr;
         bbassertexplain(!ret.returnSignal, "Unexpected return.", "Cache declaration cannot return a value. These declarations are typically created from the optimizer. This error should not normally appear.", "");
@@ -1099,9 +1329,33 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         bbassert(called.existsAndTypeEquals(CODE), "Calling a function with non-codeblock type: "+called.torepr());
         Code* code = static_cast<Code*>(called.get());
         Code* callCode = context.exists()?static_cast<Code*>(context.get()):nullptr;
+
+        // calls that do not touch struct state are submitted to the thread pool and their outcome is stored as a future
+        int carg = command.args[0];
+        if(carg!=variableManager.noneId && !forceStayInThread && code->scheduleForParallelExecution && Future::acceptsThread()
+            && memory.codeOwners.find(code)==memory.codeOwners.end() && !memory.getOrNull(variableManager.thisId, true).exists()) {
+            std::unique_ptr<BMemory> asyncMemory(new BMemory(depth, &memory, LOCAL_EXPECTATION_FROM_CODE(code)+(callCode?LOCAL_EXPECTATION_FROM_CODE(callCode):0), code->layout));
+            if(callCode) {
+                ExecutionInstance executor(depth, callCode, asyncMemory.get(), forceStayInThread);
+                auto returnedValue = executor.run(callCode);
+                if(returnedValue.returnSignal) DISPATCH_RESULT(returnedValue.get());
+            }
+            asyncMemory->parent = memory.getParentWithFinals();
+            asyncMemory->allowMutables = false;
+            if(asyncMemory->parent) asyncMemory->parent->markShared();
+            // arguments may still be referenced by the caller, so both threads must count them atomically
+            asyncMemory->shareValues();
+            code->share();
+            auto thread = std::make_shared<ThreadResult>();
+            result = DataPtr(new Future(thread));
+            memory.setFuture(carg, result);
+            memory.attached_threads.emplace_back(result);
+            thread->start(depth, code, asyncMemory.release(), &command, DataPtr::NULLP);
+            continue;
+        }
     
         // run prample
-        BMemory newMemory(depth, &memory, LOCAL_EXPECTATION_FROM_CODE(code)+(callCode?LOCAL_EXPECTATION_FROM_CODE(callCode):0));
+        BMemory newMemory(depth, &memory, LOCAL_EXPECTATION_FROM_CODE(code)+(callCode?LOCAL_EXPECTATION_FROM_CODE(callCode):0), code->layout);
         if(callCode) {
             ExecutionInstance executor(depth, callCode, &newMemory, forceStayInThread);
             auto returnedValue = executor.run(callCode);
@@ -1129,9 +1383,11 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
 
     }//end try 
     catch (const BBError& e) {
-        std::string err = enrichErrorDescription(program[i], e.what());
-        int carg = command.args.size()?command.args[0]:variableManager.noneId; 
-        if(command.operation==IS) {
+        // superinstructions may have advanced to their second command, so refer to the command at i
+        const Command& failed = program[i];
+        std::string err = enrichErrorDescription(failed, e.what());
+        int carg = failed.args.size()?failed.args[0]:variableManager.noneId; 
+        if(failed.operation==IS) {
             BError* berror = new BError(std::move(err));
             //memory.consumeAllErrors();
             result = DataPtr(berror); 
@@ -1139,7 +1395,7 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         }
 
 
-        if(command.operation!=RETURN)
+        if(failed.operation!=RETURN)
         if(carg==variableManager.noneId) {
             //err += "\n \033[33m !!! \033[0mAt this point, the error is returned because it is not assigned to"
             //       "\n      a variable and would have been ignored otherwise.\033[0m";
@@ -1148,7 +1404,7 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
             result = DataPtr(berror);
             return ExecutionInstanceRunReturn(true, Result(result));
         }
-        /*if(command.operation==IS) {
+        /*if(failed.operation==IS) {
             err += "\n \033[33m !!! \033[0mAt this point, the error is returned instead of being copied.\033[0m";
             BError* berror = new BError(std::move(err));
             result = DataPtr(berror);
@@ -1156,19 +1412,19 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
             //memory.consumeAllErrors();
             return ExecutionInstanceRunReturn(true, Result(result));
         }*/
-        if(command.operation!=RETURN)
-        if(command.operation==SET 
-            || command.operation==SETFINAL 
-            || command.operation==PUT 
-            || command.operation==POP  
-            || command.operation==PUSH 
-            || command.operation==NEXT
-            || command.operation==FAIL
-            || command.operation==MOVE
-            || command.operation==CLEAR
-            || command.operation==FINAL
-            || command.operation==BB_PRINT
-            || command.operation==READ) {
+        if(failed.operation!=RETURN)
+        if(failed.operation==SET 
+            || failed.operation==SETFINAL 
+            || failed.operation==PUT 
+            || failed.operation==POP  
+            || failed.operation==PUSH 
+            || failed.operation==NEXT
+            || failed.operation==FAIL
+            || failed.operation==MOVE
+            || failed.operation==CLEAR
+            || failed.operation==FINAL
+            || failed.operation==BB_PRINT
+            || failed.operation==READ) {
             BError* berror = new BError(std::move(err));
             result = DataPtr(berror);
             memory.consumeAllErrors();
@@ -1177,7 +1433,7 @@ ExecutionInstanceRunReturn ExecutionInstance::run(const std::vector<Command>& pr
         BError* berror = new BError(std::move(err));
         try {
             result = DataPtr(berror); 
-            if(command.operation==RETURN) {
+            if(failed.operation==RETURN) {
                 memory.consumeAllErrors();
                 return ExecutionInstanceRunReturn(true, Result(result));
             }
@@ -0,0 +1,136 @@
+/*
+   Copyright 2024 Emmanouil Krasanakis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+
+#include "interpreter/Pool.h"
+#include <mutex>
+#include <vector>
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+struct FreeBatch {
+    FreeBlock* first;
+    FreeBlock* last;
+    unsigned int count;
+};
+
+// Returned blocks are kept as the batches they were handed back in, so that threads take about a slab's
+// worth at a time without walking or detaching arbitrarily long lists while holding the lock.
+struct PoolDepot {
+    std::mutex lock;
+    std::vector<FreeBatch> batches[POOL_CLASSES];
+};
+
+// never destroyed, as objects may still be released while static destructors run at exit
+static PoolDepot& depot() {
+    static PoolDepot* ret = new PoolDepot();
+    return *ret;
+}
+
+thread_local FreeBlock* threadLists[POOL_CLASSES] = {};
+thread_local unsigned int threadCounts[POOL_CLASSES] = {};
+thread_local bool threadExited = false;
+
+static void returnToDepot(int sizeClass, FreeBlock* first, FreeBlock* last, unsigned int count) {
+    last->next = nullptr;
+    PoolDepot& shared = depot();
+    std::lock_guard<std::mutex> lock(shared.lock);
+    shared.batches[sizeClass].push_back({first, last, count});
+}
+
+class PoolFlusher {
+public:
+    ~PoolFlusher() {
+        for(int sizeClass=0;sizeClass<POOL_CLASSES;++sizeClass) {
+            FreeBlock* first = threadLists[sizeClass];
+            if(!first) continue;
+            FreeBlock* last = first;
+            while(last->next) last = last->next;
+            returnToDepot(sizeClass, first, last, threadCounts[sizeClass]);
+            threadLists[sizeClass] = nullptr;
+            threadCounts[sizeClass] = 0;
+        }
+        threadExited = true;
+    }
+};
+thread_local PoolFlusher threadFlusher;
+
+static FreeBatch refill(int sizeClass) {
+    (void)&threadFlusher; // make sure that this thread's blocks are handed back when it exits
+    FreeBatch ret = {nullptr, nullptr, 0};
+    {
+        PoolDepot& shared = depot();
+        std::lock_guard<std::mutex> lock(shared.lock);
+        auto& batches = shared.batches[sizeClass];
+        while(ret.count<POOL_SLAB_BLOCKS && !batches.empty()) {
+            FreeBatch batch = batches.back();
+            batches.pop_back();
+            if(ret.last) ret.last->next = batch.first;
+            else ret.first = batch.first;
+            ret.last = batch.last;
+            ret.count += batch.count;
+        }
+    }
+    if(ret.first) return ret;
+    size_t blockSize = (sizeClass+1)*POOL_GRANULARITY;
+    char* slab = static_cast<char*>(::operator new(blockSize*POOL_SLAB_BLOCKS));
+    for(int i=0;i<POOL_SLAB_BLOCKS-1;++i) reinterpret_cast<FreeBlock*>(slab+i*blockSize)->next = reinterpret_cast<FreeBlock*>(slab+(i+1)*blockSize);
+    FreeBlock* last = reinterpret_cast<FreeBlock*>(slab+(POOL_SLAB_BLOCKS-1)*blockSize);
+    last->next = nullptr;
+    return {reinterpret_cast<FreeBlock*>(slab), last, POOL_SLAB_BLOCKS};
+}
+
+void* poolAllocate(size_t size) {
+    if(size==0) size = 1;
+    if(size>POOL_CLASSES*POOL_GRANULARITY) [[unlikely]] return ::operator new(size);
+    int sizeClass = (size-1)/POOL_GRANULARITY;
+    if(threadExited) [[unlikely]] {
+        // blocks must still come from the pool, because they will be released to it
+        FreeBatch batch = refill(sizeClass);
+        if(batch.count>1) returnToDepot(sizeClass, batch.first->next, batch.last, batch.count-1);
+        return batch.first;
+    }
+    FreeBlock* ret = threadLists[sizeClass];
+    if(!ret) [[unlikely]] {
+        FreeBatch batch = refill(sizeClass);
+        ret = batch.first;
+        threadCounts[sizeClass] = batch.count;
+    }
+    threadLists[sizeClass] = ret->next;
+    --threadCounts[sizeClass];
+    return ret;
+}
+
+void poolRelease(void* ptr, size_t size) {
+    if(!ptr) return;
+    if(size==0) size = 1;
+    if(size>POOL_CLASSES*POOL_GRANULARITY) [[unlikely]] {::operator delete(ptr); return;}
+    int sizeClass = (size-1)/POOL_GRANULARITY;
+    FreeBlock* block = static_cast<FreeBlock*>(ptr);
+    if(threadExited) [[unlikely]] {returnToDepot(sizeClass, block, block, 1); return;}
+    block->next = threadLists[sizeClass];
+    threadLists[sizeClass] = block;
+    // blocks freed here but allocated by other threads would otherwise accumulate without bound
+    if(++threadCounts[sizeClass]>=POOL_MAX_THREAD_BLOCKS) [[unlikely]] {
+        FreeBlock* last = block;
+        for(unsigned int i=1;i<POOL_MAX_THREAD_BLOCKS/2;++i) last = last->next;
+        threadLists[sizeClass] = last->next;
+        threadCounts[sizeClass] -= POOL_MAX_THREAD_BLOCKS/2;
+        returnToDepot(sizeClass, block, last, POOL_MAX_THREAD_BLOCKS/2);
+    }
+}
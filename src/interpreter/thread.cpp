@@ -35,6 +35,7 @@ void threadExecute(unsigned int depth,
         executorLock = std::unique_lock<std::recursive_mutex>(static_cast<Struct*>(thisObj.get())->memoryLock);
     }*/
 
+    BMemory* sharedParent = memory->parent; // marked as shared by the thread submitting the call
     try {
         ExecutionInstance executor(depth, code, memory, thisObj.exists());
         auto returnedValue = executor.run(code);
@@ -57,4 +58,5 @@ void threadExecute(unsigned int depth,
         delete memory;
     } 
     catch (const BBError& e) {result->value = Result(new BError(enrichErrorDescription(*command, e.what())));}
+    if(sharedParent) sharedParent->unmarkShared();
 }
\ No newline at end of file
@@ -0,0 +1,129 @@
+/*
+   Copyright 2024 Emmanouil Krasanakis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+#include "interpreter/ThreadPool.h"
+#include "data/Future.h"
+
+#define MAX_HELP_DEPTH 8
+#define MAX_PENDING_PER_WORKER 16
+
+ThreadPool threadPool;
+thread_local int ThreadPool::workerIndex = -1;
+thread_local int ThreadPool::helpDepth = 0;
+
+ThreadPool::ThreadPool() : pending(0), submittedTasks(0), stopping(false) {}
+ThreadPool::~ThreadPool() {stop();}
+
+void ThreadPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(idleLock);
+        stopping = true;
+    }
+    idleCondition.notify_all();
+    for(auto& worker : workers) if(worker.joinable()) worker.join();
+    workers.clear();
+    queues.clear();
+    injected.clear();
+    pending = 0;
+    stopping = false;
+}
+
+void ThreadPool::resize(int numWorkers) {
+    if(numWorkers<0) numWorkers = 0;
+    if(static_cast<size_t>(numWorkers)==workers.size()) return;
+    stop();
+    queues.reserve(numWorkers);
+    for(int i=0;i<numWorkers;++i) queues.push_back(std::make_unique<WorkerQueue>());
+    workers.reserve(numWorkers);
+    for(int i=0;i<numWorkers;++i) workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+bool ThreadPool::acceptsTask() const {
+    int numWorkers = workers.size();
+    return numWorkers && pending.load(std::memory_order_relaxed) < numWorkers*MAX_PENDING_PER_WORKER;
+}
+
+void ThreadPool::submit(std::shared_ptr<ThreadResult> task) {
+    if(workerIndex>=0 && workerIndex<static_cast<int>(queues.size())) {
+        auto& queue = *queues[workerIndex];
+        std::lock_guard<std::mutex> lock(queue.lock);
+        queue.tasks.push_back(std::move(task));
+    }
+    else {
+        std::lock_guard<std::mutex> lock(injectionLock);
+        injected.push_back(std::move(task));
+    }
+    ++pending;
+    submittedTasks.fetch_add(1, std::memory_order_relaxed);
+    {std::lock_guard<std::mutex> lock(idleLock);}
+    idleCondition.notify_one();
+}
+
+std::shared_ptr<ThreadResult> ThreadPool::take(int index) {
+    std::shared_ptr<ThreadResult> task;
+    int numQueues = queues.size();
+    // own tasks are popped from the back, which keeps recently spawned (and cache-hot) calls local
+    if(index>=0 && index<numQueues) {
+        auto& queue = *queues[index];
+        std::lock_guard<std::mutex> lock(queue.lock);
+        if(queue.tasks.size()) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+    }
+    if(!task) {
+        std::lock_guard<std::mutex> lock(injectionLock);
+        if(injected.size()) {
+            task = std::move(injected.front());
+            injected.pop_front();
+        }
+    }
+    // steal the oldest tasks of other workers, as those tend to be the largest
+    for(int i=1;!task && i<=numQueues;++i) {
+        auto& queue = *queues[(index+i+numQueues)%numQueues];
+        std::lock_guard<std::mutex> lock(queue.lock);
+        if(queue.tasks.size()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+    }
+    if(task) --pending;
+    return task;
+}
+
+void ThreadPool::workerLoop(int index) {
+    workerIndex = index;
+    while(true) {
+        auto task = take(index);
+        if(task) {
+            task->tryRun();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(idleLock);
+        idleCondition.wait(lock, [this] {return stopping || pending.load()>0;});
+        if(stopping && pending.load()==0) return;
+    }
+}
+
+bool ThreadPool::help() {
+    if(helpDepth>=MAX_HELP_DEPTH) return false;
+    auto task = take(workerIndex);
+    if(!task) return false;
+    ++helpDepth;
+    task->tryRun();
+    --helpDepth;
+    return true;
+}
@@ -25,9 +25,12 @@
 #include <filesystem>
 #include <unordered_set>
 #include <unordered_map>
+#include <deque>
+#include <map>
 
 #include "BMemory.h"
 #include "data/Future.h"
+#include "data/Vector.h"
 #include "data/Code.h"
 #include "data/Jitable.h"
 #include "utils.h"
@@ -37,6 +40,7 @@ extern std::string enrichErrorDescription(const Command& command, std::string me
 extern std::unordered_map<std::string, OperationType> toOperationTypeMap;
 extern BMemory cachedData;
 extern std::vector<SymbolWorries> symbolUsage;
+extern bool load_bbvm(const std::string& fileName, std::vector<Command>* program, CommandDebugTable& debugTable, int& line, std::shared_ptr<CommandContext>& descriptor);
 
 class UnionFind {
 private:
@@ -59,13 +63,13 @@ public:
 };
 
 
-void preliminaryDependencies(std::vector<Command>* program) {
+void preliminaryDependencies(std::vector<Command>* program, FrameLayoutTable& frameLayouts) {
     std::unordered_map<int, std::unordered_set<int>> redirects;
     std::unordered_set<int> symbols;
     std::unordered_map<int, int> mergedSymbols;
     UnionFind uf;
     for (const auto& command : *program) {
-        if(command.operation==AS || command.operation==IS) {
+        if(command.operation==AS || command.operation==IS || command.operation==ISCACHED) {
             redirects[command.args[0]].insert(command.args[1]);
             redirects[command.args[1]].insert(command.args[0]);
             symbols.insert(command.args[0]);
@@ -96,6 +100,10 @@ void preliminaryDependencies(std::vector<Command>* program) {
     std::unordered_map<int, std::unordered_set<int>> affects;
     std::unordered_map<int, std::unordered_set<int>> calls; // includes inlining
     int programSize = program->size();
+    std::unordered_set<int> definedBlocks;
+    for(const auto& command : *program) 
+        if(command.operation==BEGIN || command.operation==BEGINFINAL) 
+            definedBlocks.insert(mergedSymbols.find(command.args[0])==mergedSymbols.end()?command.args[0]:mergedSymbols[command.args[0]]);
 
     // compile code blocks while we are at it
     for(int i=-1;i<programSize;++i) {
@@ -171,6 +179,12 @@ void preliminaryDependencies(std::vector<Command>* program) {
                 }
                 if(command_type == CALL) {
                     fullyControlledVariables.clear();
+                    // calling something that is not a known code block (e.g., a function argument) may have any side effect
+                    int calledGroup = mergedSymbols.find(codeCommand.args[2])!=mergedSymbols.end()?mergedSymbols[codeCommand.args[2]]:codeCommand.args[2];
+                    if(definedBlocks.find(calledGroup)==definedBlocks.end()) {
+                        if(mergedSymbols.find(variableManager.consoleId)!=mergedSymbols.end()) affects[commandSymbolGroup].insert(mergedSymbols[variableManager.consoleId]);
+                        else affects[commandSymbolGroup].insert(variableManager.consoleId);
+                    }
                     if(mergedSymbols.find(variableManager.callId)!=mergedSymbols.end()) calls[commandSymbolGroup].insert(mergedSymbols[variableManager.callId]);
                     if(mergedSymbols.find(codeCommand.args[1])!=mergedSymbols.end()) calls[commandSymbolGroup].insert(mergedSymbols[codeCommand.args[1]]);
                     else calls[commandSymbolGroup].insert(codeCommand.args[1]);
@@ -487,10 +501,15 @@ void preliminaryDependencies(std::vector<Command>* program) {
                     }
                     continue;
                 }
+                // plain assignments only write to the frame of the running block, so they are not recorded as affected fields
                 int assignmentPos = 0;
-                if(codeCommand.args.size()>assignmentPos && codeCommand.args[0]!=variableManager.noneId) {
-                    if(mergedSymbols.find(codeCommand.args[0])!=mergedSymbols.end()) affects[commandSymbolGroup].insert(mergedSymbols[codeCommand.args[0]]);
-                    else affects[commandSymbolGroup].insert(codeCommand.args[0]);
+                if(command_type == CLEAR || command_type == MOVE) {
+                    if(mergedSymbols.find(variableManager.synchronizedListModification)!=mergedSymbols.end()) affects[commandSymbolGroup].insert(mergedSymbols[variableManager.synchronizedListModification]);
+                    else affects[commandSymbolGroup].insert(variableManager.synchronizedListModification);
+                }
+                if(command_type == CREATESERVER) {
+                    if(mergedSymbols.find(variableManager.consoleId)!=mergedSymbols.end()) affects[commandSymbolGroup].insert(mergedSymbols[variableManager.consoleId]);
+                    else affects[commandSymbolGroup].insert(variableManager.consoleId);
                 }
                 for(int c=assignmentPos+1;c<codeCommand.args.size();++c) if(codeCommand.args[c]!=variableManager.thisId) {
                     if(mergedSymbols.find(codeCommand.args[c])!=mergedSymbols.end()) uses[commandSymbolGroup].insert(mergedSymbols[codeCommand.args[c]]);
@@ -503,7 +522,18 @@ void preliminaryDependencies(std::vector<Command>* program) {
         if(original_i!=-1) {
             auto cache = new Code(program, i + 1, pos, command_type == END?(pos-1):pos);
             cache->addOwner();
+            cache->share(); // all threads calling the enclosing code count their references to this block
             cache->jitable = jit(cache);
+            // nested blocks run in frames of their own, so only their declaration is assigned here
+            std::vector<int> assignedSymbols;
+            int nested = 0;
+            for(size_t j=i+1;j<pos;++j) {
+                const Command& assigning = (*program)[j];
+                if(nested==0 && assigning.args.size()) assignedSymbols.push_back(assigning.args[0]);
+                if(assigning.operation == BEGIN || assigning.operation == BEGINFINAL || assigning.operation == BEGINCACHE) nested++;
+                else if(assigning.operation == END) nested--;
+            }
+            cache->layout = frameLayouts.add(assignedSymbols);
             (*program)[i].value = cache;
         }
         else i = -1;
@@ -570,7 +600,56 @@ void preliminaryDependencies(std::vector<Command>* program) {
 }
 
 
-void preliminarySimpleChecks(std::vector<Command>* program) {
+bool reportFusions = false;
+
+// Fuses consecutive commands into superinstructions when the value passed from the first to the second is an intermediate 
+// that nothing else reads. Only the operation of the first command changes. The second one stays in place, so that
+// code block boundaries do not move and superinstructions can fall back to running both commands separately.
+void fuseSuperinstructions(std::vector<Command>* program) {
+    std::unordered_map<int, int> reads;
+    for(const auto& command : *program) for(int j=1;j<command.args.size();++j) reads[command.args[j]]++;
+    std::map<std::string, int> fired;
+    size_t programSize = program->size();
+    for(size_t i=0;i+1<programSize;++i) {
+        Command& command = (*program)[i];
+        const Command& next = (*program)[i+1];
+        if(command.args.size()==0 || next.args.size()<3) continue;
+        int intermediate = command.args[0];
+        if(intermediate==variableManager.noneId || reads[intermediate]!=1) continue;
+        if(variableManager.getSymbol(intermediate).rfind("_bb", 0)!=0) continue;
+        OperationType fused = command.operation;
+        if(command.operation==BUILTIN && (command.value.isint() || command.value.isfloat()) && (next.args[1]==intermediate || next.args[2]==intermediate)) {
+            if(next.operation==ADD) fused = BUILTIN_ADD;
+            else if(next.operation==SUB) fused = BUILTIN_SUB;
+            else if(next.operation==MUL) fused = BUILTIN_MUL;
+            else if(next.operation==LT) fused = BUILTIN_LT;
+            else if(next.operation==LE) fused = BUILTIN_LE;
+            else if(next.operation==GT) fused = BUILTIN_GT;
+            else if(next.operation==GE) fused = BUILTIN_GE;
+            else if(next.operation==EQ) fused = BUILTIN_EQ;
+            else if(next.operation==NEQ) fused = BUILTIN_NEQ;
+        }
+        else if(next.operation==IF && next.args[1]==intermediate) {
+            if(command.operation==LT) fused = LT_IF;
+            else if(command.operation==LE) fused = LE_IF;
+            else if(command.operation==GT) fused = GT_IF;
+            else if(command.operation==GE) fused = GE_IF;
+            else if(command.operation==EQ) fused = EQ_IF;
+            else if(command.operation==NEQ) fused = NEQ_IF;
+        }
+        if(fused==command.operation) continue;
+        fired[getOperationTypeName(fused)]++;
+        command.operation = fused;
+        ++i; // the second command of a superinstruction does not start another one
+    }
+    if(!reportFusions) return;
+    std::cout << "Superinstructions fused while loading:\n";
+    if(fired.empty()) std::cout << "  none\n";
+    for(const auto& [name, count] : fired) std::cout << "  " << name << " " << count << "\n";
+}
+
+
+void validateProgram(std::vector<Command>* program) {
     // the following is a sanity check to prevent external bbvm code from being invalid
     int depth = 0;
     for (const auto& command : *program) {
@@ -601,7 +680,7 @@ void preliminarySimpleChecks(std::vector<Command>* program) {
         if(op==NEXT) bbassertexplain(size==2, "Invalid bbvm instruction: "+command.toString(), "`next` accepts exactly 1 argument after the return value", getStackFrame(command));
         if(op==PUT) bbassertexplain(size==4, "Invalid bbvm instruction: "+command.toString(), "`put` accepts exactly 3 arguments after the return value", getStackFrame(command));
         if(op==AT) bbassertexplain(size==3, "Invalid bbvm instruction: "+command.toString(), "`at` accepts exactly 2 arguments after the return value", getStackFrame(command));
-        if(op==SHAPE) bbassertexplain(size==3, "Invalid bbvm instruction: "+command.toString(), "`shape` accepts exactly 2 arguments after the return value", getStackFrame(command));
+        if(op==SHAPE) bbassertexplain(size>=2, "Invalid bbvm instruction: "+command.toString(), "`shape` accepts a vector optionally followed by its new dimensions after the return value", getStackFrame(command));
         if(op==TOVECTOR) bbassertexplain(size==2, "Invalid bbvm instruction: "+command.toString(), "`vector` accepts exactly 1 argument after the return value", getStackFrame(command));
         if(op==TOLIST) bbassertexplain(size==2 || size==1, "Invalid bbvm instruction: "+command.toString(), "`list` accepts 1 or no arguments after the return value", getStackFrame(command));
         if(op==TOMAP) bbassertexplain(size==2 || size==1, "Invalid bbvm instruction: "+command.toString(), "`map` accepts 1 or no arguments after the return value", getStackFrame(command));
@@ -631,6 +710,7 @@ void preliminarySimpleChecks(std::vector<Command>* program) {
         if(op==SET) bbassertexplain(size==4, "Invalid bbvm instruction: "+command.toString(), "`set` accepts exactly 3 arguments after the return value", getStackFrame(command));
         if(op==SETFINAL) bbassertexplain(size==4, "Invalid bbvm instruction: "+command.toString(), "`setfinal` accepts exactly 3 arguments after the return value", getStackFrame(command));
         if(op==DEFAULT) bbassertexplain(size==2, "Invalid bbvm instruction: "+command.toString(), "`default` accepts exactly 1 argument after the return value", getStackFrame(command));
+        if(op==STATS) bbassertexplain(size==1, "Invalid bbvm instruction: "+command.toString(), "`stats` accepts no arguments after the return value", getStackFrame(command));
         if(op==TIME) bbassertexplain(size==1, "Invalid bbvm instruction: "+command.toString(), "`default` accepts no arguments after the return value", getStackFrame(command));
         if(op==TOITER) bbassertexplain(size==2, "Invalid bbvm instruction: "+command.toString(), "`iter` accepts exactly 1 argument after the return value", getStackFrame(command));
         if(op==TRY) bbassertexplain(size==2, "Invalid bbvm instruction: "+command.toString(), "`try` accepts exactly 1 argument after the return value", getStackFrame(command));
@@ -653,6 +733,7 @@ void preliminarySimpleChecks(std::vector<Command>* program) {
         if(op==ALLOCVECTOR) bbassertexplain(size==2, "Invalid bbvm instruction: "+command.toString(), "`vector::alloc` accepts exactly 1 argument after the return value", getStackFrame(command));
         if(op==LISTELEMENT) bbassertexplain(size>=2, "Invalid bbvm instruction: "+command.toString(), "`list::element` accepts at least 1 argument after the return value", getStackFrame(command));
         if(op==LISTGATHER) bbassertexplain(size>=2, "Invalid bbvm instruction: "+command.toString(), "`list::gather` accepts at least 1 argument after the return value", getStackFrame(command));
+        if(op>=BUILTIN_ADD) bberrorexplain("Invalid bbvm instruction: "+command.toString(), "Superinstructions are only created while loading programs and cannot be part of bbvm files", getStackFrame(command));
 
         if(op==BEGIN || op==BEGINCACHE || op==BEGINFINAL) depth++;
         if(op==END) {
@@ -672,20 +753,20 @@ void preliminarySimpleChecks(std::vector<Command>* program) {
         if(command.operation==SETFINAL)  symbolDefinitions.insert(command.args[1]);
         if(command.operation==SETFINAL)  symbolDefinitions.insert(command.args[2]);
     }
-    symbolDefinitions.insert(variableManager.getId("io::key"));
-    symbolDefinitions.insert(variableManager.getId("io::type"));
-    symbolDefinitions.insert(variableManager.getId("io::x"));
-    symbolDefinitions.insert(variableManager.getId("io::y"));
-    symbolDefinitions.insert(variableManager.getId("io::username"));
-    symbolDefinitions.insert(variableManager.getId("io::password"));
-    symbolDefinitions.insert(variableManager.getId("io::timeout"));
-    symbolDefinitions.insert(variableManager.getId("server::uri"));
-    symbolDefinitions.insert(variableManager.getId("server::query"));
-    symbolDefinitions.insert(variableManager.getId("server::method"));
-    symbolDefinitions.insert(variableManager.getId("server::http"));
-    symbolDefinitions.insert(variableManager.getId("server::ip"));
-    symbolDefinitions.insert(variableManager.getId("server::ssl"));
-    symbolDefinitions.insert(variableManager.getId("server::content"));
+    symbolDefinitions.insert(variableManager.ioKey);
+    symbolDefinitions.insert(variableManager.ioType);
+    symbolDefinitions.insert(variableManager.ioX);
+    symbolDefinitions.insert(variableManager.ioY);
+    symbolDefinitions.insert(variableManager.ioUsername);
+    symbolDefinitions.insert(variableManager.ioPassword);
+    symbolDefinitions.insert(variableManager.ioTimeout);
+    symbolDefinitions.insert(variableManager.serverUri);
+    symbolDefinitions.insert(variableManager.serverQuery);
+    symbolDefinitions.insert(variableManager.serverMethod);
+    symbolDefinitions.insert(variableManager.serverHttp);
+    symbolDefinitions.insert(variableManager.serverIp);
+    symbolDefinitions.insert(variableManager.serverSsl);
+    symbolDefinitions.insert(variableManager.serverContent);
     for (const auto& command : *program) {
         for(int arg : command.args) {
             if(arg==variableManager.thisId || arg==variableManager.noneId || arg==variableManager.argsId) continue;
@@ -694,48 +775,64 @@ void preliminarySimpleChecks(std::vector<Command>* program) {
                 getStackFrame(command));
         }
     }
-    preliminaryDependencies(program);
+}
+
+void preliminarySimpleChecks(std::vector<Command>* program, FrameLayoutTable& frameLayouts) {
+    validateProgram(program);
+    preliminaryDependencies(program, frameLayouts);
+    fuseSuperinstructions(program);
 }
 
 
 int vm(const std::string& fileName, int numThreads) {
     Future::setMaxThreads(numThreads);
+    Vector::setMaxThreads(numThreads);
     bool hadError = false;
+    CommandDebugTable debugTable;
+    FrameLayoutTable frameLayouts;
     std::vector<Command> program;
     try {
         {
-            std::unique_ptr<std::istream> inputFile;
-            std::string contents;
-
-            try {
-                contents = read_decompressed(fileName);
-                inputFile = std::make_unique<std::stringstream>(contents);
-            } 
-            catch (...) {
-                std::unique_ptr<std::ifstream> input = std::make_unique<std::ifstream>(fileName);
-                bbassert(input->is_open(), "Unable to open file: " + fileName);
-                inputFile = std::move(input);
-            }
-
             auto source = std::make_shared<SourceFile>(fileName);
-            std::string line;
             int i = 1;
-            
-            //program.emplace_back("BEGIN _bbmain", source, 0, new CommandContext("main context start"));
             std::shared_ptr<CommandContext> descriptor = nullptr;
-            while (std::getline(*inputFile, line)) {
-                if (line.size()==0) {}
-                else if (line[0] != '%') program.emplace_back(line, source, i, descriptor);
-                else descriptor = std::make_shared<CommandContext>(line.substr(1));
-                ++i;
+            bool validated = false;
+            if(is_binary_bbvm_file(fileName)) validated = load_bbvm(fileName, &program, debugTable, i, descriptor);
+            else {
+                std::unique_ptr<std::istream> inputFile;
+                std::string contents;
+
+                try {
+                    contents = read_decompressed(fileName);
+                    inputFile = std::make_unique<std::stringstream>(contents);
+                } 
+                catch (...) {
+                    std::unique_ptr<std::ifstream> input = std::make_unique<std::ifstream>(fileName);
+                    bbassert(input->is_open(), "Unable to open file: " + fileName);
+                    inputFile = std::move(input);
+                }
+
+                std::string line;
+                //program.emplace_back("BEGIN _bbmain", source, 0, new CommandContext("main context start"));
+                while (std::getline(*inputFile, line)) {
+                    if (line.size()==0) {}
+                    else if (line[0] != '%') program.emplace_back(line, source, i, descriptor, debugTable);
+                    else descriptor = std::make_shared<CommandContext>(line.substr(1));
+                    ++i;
+                }
             }
 
             //program.emplace_back("END", source, program.size()-1, new CommandContext("main context end"));
             //program.emplace_back("call _bbmainresult # _bbmain", source, program.size()-1, new CommandContext("main context run"));
 
             // the following ensure smooth close-up even if the program is terminated through logically a non-assigned call
-            program.emplace_back("BUILTIN _bbdonothing I0", source, i, descriptor);
-            preliminarySimpleChecks(&program);
+            program.emplace_back("BUILTIN _bbdonothing I0", source, i, descriptor, debugTable);
+            if(validated) {
+                // binary files were validated when written and their checksums were verified while loading
+                preliminaryDependencies(&program, frameLayouts);
+                fuseSuperinstructions(&program);
+            }
+            else preliminarySimpleChecks(&program, frameLayouts);
             
             BMemory memory(0, nullptr, DEFAULT_LOCAL_EXPECTATION);
             try {
@@ -772,7 +869,10 @@ extern std::string optimizeFromCode(const std::string& code, bool minimify);
 
 int vmFromSourceCode(const std::string& sourceCode, int numThreads) {
     Future::setMaxThreads(numThreads);
+    Vector::setMaxThreads(numThreads);
     bool hadError = false;
+    CommandDebugTable debugTable;
+    FrameLayoutTable frameLayouts;
     std::vector<Command> program;
     try {
         {
@@ -790,13 +890,13 @@ int vmFromSourceCode(const std::string& sourceCode, int numThreads) {
                 std::shared_ptr<CommandContext> descriptor = nullptr;
                 while (std::getline(inputFile, line)) {
                     if(line.size()==0) {}
-                    else if (line[0] != '%') program.emplace_back(line, source, i, descriptor);
+                    else if (line[0] != '%') program.emplace_back(line, source, i, descriptor, debugTable);
                     else descriptor = std::make_shared<CommandContext>(line.substr(1));
                     ++i;
                 }
                 // the following ensure smooth close-up even if the program is terminated through logically a non-assigned call
-                program.emplace_back("BUILTIN _bbdonothing I0", source, i, descriptor);
-                preliminarySimpleChecks(&program);
+                program.emplace_back("BUILTIN _bbdonothing I0", source, i, descriptor, debugTable);
+                preliminarySimpleChecks(&program, frameLayouts);
 
                 Code code(&program, 0, program.size() - 1, program.size() - 1);
                 if(numThreads) {
@@ -0,0 +1,610 @@
+/*
+   Copyright 2024 Emmanouil Krasanakis
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+ */
+
+/**
+ * Binary .bbvm files consist of a header, a section table, and the sections themselves:
+ * a symbol table with the retain flags of symbols, a constant pool, debug descriptors, and the instruction stream. Sections are
+ * 8-byte aligned, addressed only through offsets, and carry a crc32 checksum. The instruction
+ * stream is split into chunks of BBVM_CHUNK instructions that are compressed independently, so that
+ * loading can decompress and decode chunks in parallel while never holding the whole decompressed
+ * program. Other sections are compressed as a whole. Sections or chunks that do not shrink are stored
+ * as-is. Instructions are validated once when complete programs are written, so loading them only
+ * verifies checksums. Libraries may refer to symbols of the programs that include them and are
+ * validated there. Files also store the source files they were compiled from, so that
+ * unchanged programs are not recompiled, and a hash of the operation table, so that files whose
+ * instructions number operations differently are rejected. All numbers are stored with the byte order of the compiling machine.
+ */
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <bit>
+#include <exception>
+#include <unordered_map>
+#include <zlib.h>
+#include "utils.h"
+#include "common.h"
+#include "BMemory.h"
+#include "interpreter/Command.h"
+#include "data/BString.h"
+#define XXH_NO_STREAM
+#include "xxhash.h"
+
+extern void validateProgram(std::vector<Command>* program);
+extern std::string toUnicodeAndAnsi(const std::string& input);
+extern std::string normalizeFilePath(const std::string& path);
+extern void addAllowedLocation(const std::string& location);
+extern void addAllowedWriteLocation(const std::string& location);
+
+#define BBVM_VERSION 4
+#define BBVM_NONE UINT32_MAX
+#define BBVM_VALIDATED 1
+#define BBVM_CHUNK 4096
+
+enum BbvmSectionKind : uint32_t {BBVM_SYMBOLS = 1, BBVM_CONSTANTS = 2, BBVM_CODE = 3, BBVM_DEBUG = 4, BBVM_SOURCES = 5};
+static constexpr char BBVM_MAGIC[4] = {'B', 'B', 'V', 'M'};
+
+struct BbvmHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t sections;
+    uint32_t flags;
+    uint64_t operations; // hash of the operation table, because instructions store operation numbers
+};
+
+struct BbvmSection {
+    uint32_t kind;
+    uint32_t checksum;
+    uint64_t offset;
+    uint64_t size;
+    uint64_t rawSize; // differs from size for compressed sections
+};
+
+struct BbvmChunk {
+    uint32_t instructions;
+    uint32_t rawSize;
+    uint64_t offset; // from the start of the code section
+    uint64_t size;
+};
+
+class BbvmWriter {
+public:
+    std::string data;
+    inline void u8(uint8_t value) {data.push_back(static_cast<char>(value));}
+    inline void u16(uint16_t value) {data.append(reinterpret_cast<const char*>(&value), sizeof(value));}
+    inline void u32(uint32_t value) {data.append(reinterpret_cast<const char*>(&value), sizeof(value));}
+    inline void u64(uint64_t value) {data.append(reinterpret_cast<const char*>(&value), sizeof(value));}
+    inline void str(const std::string& value) {u32(value.size()); data += value;}
+    template <typename T> inline void raw(const T& value) {data.append(reinterpret_cast<const char*>(&value), sizeof(value));}
+};
+
+class BbvmReader {
+    const char* data;
+    size_t size;
+    size_t pos;
+public:
+    BbvmReader(const char* data, size_t size) : data(data), size(size), pos(0) {}
+    template <typename T> inline T read() {
+        bbassertexplain(pos+sizeof(T)<=size, "Corrupted bbvm file", "A section ends before its contents. The file may have been tempered with or truncated.", "");
+        T value;
+        std::memcpy(&value, data+pos, sizeof(T));
+        pos += sizeof(T);
+        return value;
+    }
+    inline std::string str() {
+        uint32_t length = read<uint32_t>();
+        bbassertexplain(pos+length<=size, "Corrupted bbvm file", "A section ends before its contents. The file may have been tempered with or truncated.", "");
+        std::string value(data+pos, length);
+        pos += length;
+        return value;
+    }
+};
+
+static std::string readWholeFile(const std::string& source) {
+    std::ifstream input(source, std::ios::in | std::ios::binary);
+    if(!input.is_open()) throw std::runtime_error("Unable to read from file: " + source);
+    input.seekg(0, std::ios::end);
+    std::string contents(static_cast<size_t>(input.tellg()), '\0');
+    input.seekg(0, std::ios::beg);
+    input.read(&contents[0], static_cast<std::streamsize>(contents.size()));
+    return contents;
+}
+
+// returns the zlib-compressed data, or the data itself if compression does not shrink it
+static std::string deflateBlock(const std::string& data) {
+    uLong destLen = compressBound(data.size());
+    std::string compressed(destLen, '\0');
+    int res = compress(reinterpret_cast<Bytef*>(&compressed[0]), &destLen, reinterpret_cast<const Bytef*>(data.data()), data.size());
+    if(res!=Z_OK || destLen>=data.size()) return data;
+    compressed.resize(destLen);
+    return compressed;
+}
+
+static std::string inflateBlock(const char* data, size_t size, size_t rawSize) {
+    if(size==rawSize) return std::string(data, size);
+    std::string decompressed(rawSize, '\0');
+    uLongf destLen = rawSize;
+    int res = uncompress(reinterpret_cast<Bytef*>(&decompressed[0]), &destLen, reinterpret_cast<const Bytef*>(data), size);
+    bbassertexplain(res==Z_OK && destLen==rawSize, "Corrupted bbvm file", "A compressed block could not be decompressed. The file may have been tempered with.", "");
+    return decompressed;
+}
+
+CompiledSources compiledSources;
+
+void CompiledSources::reset() {
+    files.clear();
+    access.clear();
+    modify.clear();
+    cacheable = true;
+}
+
+CompiledSources::Entry CompiledSources::hash(const std::string& path, const std::string& contents) {
+    XXH128_hash_t hash = XXH3_128bits(contents.data(), contents.size());
+    return Entry{path, hash.low64, hash.high64};
+}
+
+CompiledSources::Entry CompiledSources::add(const std::string& path, const std::string& contents) {
+    Entry entry = hash(path, contents);
+    for(const auto& file : files) if(file.path==path && file.low==entry.low && file.high==entry.high) return entry;
+    files.push_back(entry);
+    return entry;
+}
+
+bool is_binary_bbvm(const std::string& contents) {
+    return contents.size()>=sizeof(BbvmHeader) && std::memcmp(contents.data(), BBVM_MAGIC, sizeof(BBVM_MAGIC))==0;
+}
+
+void write_bbvm(const std::string& destination, const std::string& code, bool validate) {
+    std::vector<std::string> symbols;
+    std::unordered_map<std::string, uint32_t> symbolIndex;
+    std::unordered_map<std::string, uint32_t> constantIndex;
+    std::vector<std::string> descriptors;
+    BbvmWriter symbolSection, constantSection, debugSection;
+    uint32_t numConstants = 0;
+    uint32_t numInstructions = 0;
+    uint32_t descriptor = BBVM_NONE;
+    std::vector<std::string> chunks;
+    std::vector<uint32_t> chunkInstructions;
+
+    // parse into commands to validate everything once here instead of every time the file is loaded
+    CommandDebugTable debugTable;
+    std::vector<Command> program;
+    auto source = std::make_shared<SourceFile>(destination);
+    std::shared_ptr<CommandContext> context = nullptr;
+    std::istringstream input(code);
+    std::string line;
+    int i = 1;
+    try {
+        while (std::getline(input, line)) {
+            if (line.size()==0) {++i; continue;}
+            if (line[0] == '%') {
+                context = std::make_shared<CommandContext>(line.substr(1));
+                descriptor = descriptors.size();
+                descriptors.push_back(line.substr(1));
+                ++i;
+                continue;
+            }
+            program.emplace_back(line, source, i, context, debugTable);
+            std::vector<std::string> argNames = Command::split(line);
+            OperationType operation = getOperationType(argNames[0]);
+            int nargs = argNames.size() - 1;
+            uint32_t constant = BBVM_NONE;
+            if (operation == BUILTIN) {
+                nargs -= 1;
+                const std::string& raw = argNames[2];
+                auto it = constantIndex.find(raw);
+                if(it!=constantIndex.end()) constant = it->second;
+                else {
+                    constant = numConstants++;
+                    constantIndex[raw] = constant;
+                    const DataPtr& value = program.back().value;
+                    constantSection.u8(raw[0]);
+                    if(raw[0]=='"') constantSection.str(raw.substr(1, raw.size()-2));
+                    else if(raw[0]=='F') constantSection.u64(std::bit_cast<uint64_t>(value.unsafe_tofloat()));
+                    else constantSection.u64(value.unsafe_toint());
+                }
+            }
+            if(numInstructions%BBVM_CHUNK==0) {
+                chunks.emplace_back();
+                chunkInstructions.push_back(0);
+            }
+            BbvmWriter instruction;
+            instruction.u16(operation);
+            instruction.u16(nargs);
+            instruction.u32(constant);
+            instruction.u32(i);
+            instruction.u32(descriptor);
+            for(int arg=1;arg<=nargs;++arg) {
+                const std::string& name = argNames[arg];
+                auto it = symbolIndex.find(name);
+                if(it!=symbolIndex.end()) {instruction.u32(it->second); continue;}
+                uint32_t id = symbols.size();
+                symbolIndex[name] = id;
+                symbols.push_back(name);
+                instruction.u32(id);
+            }
+            chunks.back() += instruction.data;
+            ++chunkInstructions.back();
+            ++numInstructions;
+            ++i;
+        }
+        if(validate) validateProgram(&program);
+    }
+    catch (const BBError& e) {
+        for(const auto& command : program) command.value.existsRemoveFromOwner();
+        throw;
+    }
+    for(const auto& command : program) command.value.existsRemoveFromOwner();
+
+    symbolSection.u32(symbols.size());
+    for(const auto& symbol : symbols) {
+        symbolSection.str(symbol);
+        symbolSection.u8(VariableManager::defaultRetain(symbol));
+    }
+    constantSection.data = std::string(reinterpret_cast<const char*>(&numConstants), sizeof(numConstants)) + constantSection.data;
+    debugSection.u32(descriptors.size());
+    for(const auto& desc : descriptors) debugSection.str(desc);
+
+    // chunks are compressed independently from each other
+    int numChunks = chunks.size();
+    std::vector<std::string> compressedChunks(numChunks);
+    #pragma omp parallel for schedule(dynamic)
+    for(int c=0;c<numChunks;++c) compressedChunks[c] = deflateBlock(chunks[c]);
+    BbvmWriter codeSection;
+    codeSection.u32(numInstructions);
+    codeSection.u32(numChunks);
+    uint64_t chunkOffset = codeSection.data.size() + numChunks*sizeof(BbvmChunk);
+    for(int c=0;c<numChunks;++c) {
+        BbvmChunk chunk;
+        chunk.instructions = chunkInstructions[c];
+        chunk.rawSize = chunks[c].size();
+        chunk.offset = chunkOffset;
+        chunk.size = compressedChunks[c].size();
+        codeSection.raw(chunk);
+        chunkOffset += chunk.size;
+    }
+    for(int c=0;c<numChunks;++c) codeSection.data += compressedChunks[c];
+
+    std::vector<std::tuple<BbvmSectionKind, std::string, uint64_t>> sections;
+    sections.emplace_back(BBVM_SYMBOLS, deflateBlock(symbolSection.data), symbolSection.data.size());
+    sections.emplace_back(BBVM_CONSTANTS, deflateBlock(constantSection.data), constantSection.data.size());
+    sections.emplace_back(BBVM_DEBUG, deflateBlock(debugSection.data), debugSection.data.size());
+    sections.emplace_back(BBVM_CODE, std::move(codeSection.data), chunkOffset);
+    if(compiledSources.cacheable && compiledSources.files.size()) {
+        BbvmWriter sourceSection;
+        sourceSection.str(compiledSources.options);
+        sourceSection.u32(compiledSources.files.size());
+        for(const auto& entry : compiledSources.files) {
+            sourceSection.str(entry.path);
+            sourceSection.u64(entry.low);
+            sourceSection.u64(entry.high);
+        }
+        sourceSection.u32(compiledSources.access.size());
+        for(const auto& location : compiledSources.access) sourceSection.str(location);
+        sourceSection.u32(compiledSources.modify.size());
+        for(const auto& location : compiledSources.modify) sourceSection.str(location);
+        sections.emplace_back(BBVM_SOURCES, deflateBlock(sourceSection.data), sourceSection.data.size());
+    }
+    BbvmHeader header;
+    std::memcpy(header.magic, BBVM_MAGIC, sizeof(BBVM_MAGIC));
+    header.version = BBVM_VERSION;
+    header.sections = sections.size();
+    header.flags = validate?BBVM_VALIDATED:0;
+    header.operations = getOperationTableHash();
+    uint64_t offset = sizeof(BbvmHeader) + sections.size()*sizeof(BbvmSection);
+    std::vector<BbvmSection> table;
+    for(const auto& [kind, contents, rawSize] : sections) {
+        offset = (offset+7) & ~static_cast<uint64_t>(7);
+        BbvmSection section;
+        section.kind = kind;
+        section.checksum = crc32(0L, reinterpret_cast<const Bytef*>(contents.data()), contents.size());
+        section.offset = offset;
+        section.size = contents.size();
+        section.rawSize = rawSize;
+        table.push_back(section);
+        offset += contents.size();
+    }
+
+    std::ofstream outputFile(destination, std::ios::binary);
+    bbassert(outputFile.is_open(), "Unable to write to file: " + destination);
+    outputFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    outputFile.write(reinterpret_cast<const char*>(table.data()), table.size()*sizeof(BbvmSection));
+    uint64_t written = sizeof(BbvmHeader) + table.size()*sizeof(BbvmSection);
+    for(size_t s=0;s<sections.size();++s) {
+        std::string padding(table[s].offset-written, '\0');
+        outputFile.write(padding.data(), padding.size());
+        outputFile.write(std::get<1>(sections[s]).data(), table[s].size);
+        written = table[s].offset + table[s].size;
+    }
+    outputFile.close();
+}
+
+/**
+ * Sections of a binary bbvm file whose checksums have been verified. Compressed sections other than
+ * the instruction stream are decompressed here, whereas the chunks of the latter are decompressed on demand.
+ */
+class BbvmFile {
+    std::unordered_map<uint32_t, std::string> inflated;
+    std::unordered_map<uint32_t, std::pair<const char*, size_t>> located;
+public:
+    BbvmHeader header;
+    BbvmFile(const std::string& contents) {
+        std::memcpy(&header, contents.data(), sizeof(header));
+        bbassertexplain(header.version==BBVM_VERSION, "Unsupported bbvm file version "+std::to_string(header.version),
+            "This file was compiled by a different version of Blombly and should be recompiled from its sources.", "");
+        bbassertexplain(header.operations==getOperationTableHash(), "Unsupported bbvm file operations",
+            "This file was compiled by a build of Blombly with different operations and should be recompiled from its sources.", "");
+        bbassertexplain(sizeof(BbvmHeader)+header.sections*sizeof(BbvmSection)<=contents.size(), "Corrupted bbvm file", "The section table is truncated.", "");
+        for(uint32_t s=0;s<header.sections;++s) {
+            BbvmSection section;
+            std::memcpy(&section, contents.data()+sizeof(BbvmHeader)+s*sizeof(BbvmSection), sizeof(section));
+            bbassertexplain(section.offset<=contents.size() && section.size<=contents.size()-section.offset, "Corrupted bbvm file", "A section lies outside the file. The file may have been tempered with or truncated.", "");
+            const char* data = contents.data()+section.offset;
+            bbassertexplain(crc32(0L, reinterpret_cast<const Bytef*>(data), section.size)==section.checksum, "Corrupted bbvm file", "A section checksum does not match its contents. The file may have been tempered with.", "");
+            if(section.kind==BBVM_CODE || section.size==section.rawSize) located[section.kind] = {data, section.size};
+            else {
+                inflated[section.kind] = inflateBlock(data, section.size, section.rawSize);
+                located[section.kind] = {inflated[section.kind].data(), section.rawSize};
+            }
+        }
+        for(uint32_t kind : {BBVM_SYMBOLS, BBVM_CONSTANTS, BBVM_CODE, BBVM_DEBUG})
+            bbassertexplain(located.find(kind)!=located.end(), "Corrupted bbvm file", "A required section is missing.", "");
+    }
+    BbvmFile(const BbvmFile&) = delete;
+    inline BbvmReader reader(uint32_t kind) const {
+        const auto& [data, size] = located.at(kind);
+        return BbvmReader(data, size);
+    }
+    inline std::vector<BbvmChunk> chunks(uint32_t& numInstructions) const {
+        BbvmReader code = reader(BBVM_CODE);
+        numInstructions = code.read<uint32_t>();
+        uint32_t numChunks = code.read<uint32_t>();
+        std::vector<BbvmChunk> ret(numChunks);
+        uint32_t total = 0;
+        for(auto& chunk : ret) {
+            chunk = code.read<BbvmChunk>();
+            bbassertexplain(chunk.offset<=located.at(BBVM_CODE).second && chunk.size<=located.at(BBVM_CODE).second-chunk.offset, "Corrupted bbvm file", "An instruction chunk lies outside its section.", "");
+            total += chunk.instructions;
+        }
+        bbassertexplain(total==numInstructions, "Corrupted bbvm file", "Instruction chunks do not add up to the program.", "");
+        return ret;
+    }
+    inline std::string chunk(const BbvmChunk& chunk) const {return inflateBlock(located.at(BBVM_CODE).first+chunk.offset, chunk.size, chunk.rawSize);}
+};
+
+bool load_bbvm(const std::string& fileName, std::vector<Command>* program, CommandDebugTable& debugTable, int& line, std::shared_ptr<CommandContext>& descriptor) {
+    std::string contents = readWholeFile(fileName);
+    BbvmFile file(contents);
+    auto source = std::make_shared<SourceFile>(fileName);
+
+    BbvmReader symbolSection = file.reader(BBVM_SYMBOLS);
+    uint32_t numSymbols = symbolSection.read<uint32_t>();
+    std::vector<std::string> names(numSymbols);
+    std::vector<char> retain(numSymbols);
+    for(uint32_t i=0;i<numSymbols;++i) {
+        names[i] = symbolSection.str();
+        retain[i] = symbolSection.read<uint8_t>();
+    }
+    std::vector<int> symbols = variableManager.registerSymbols(names, retain);
+
+    BbvmReader constantSection = file.reader(BBVM_CONSTANTS);
+    uint32_t numConstants = constantSection.read<uint32_t>();
+    std::vector<DataPtr> constants(numConstants);
+    for(uint32_t i=0;i<numConstants;++i) {
+        char type = constantSection.read<char>();
+        if(type=='"') constants[i] = BString::intern(toUnicodeAndAnsi(constantSection.str()));
+        else if(type=='F') constants[i] = DataPtr(std::bit_cast<double>(constantSection.read<uint64_t>()));
+        else if(type=='B') constants[i] = DataPtr(constantSection.read<uint64_t>()!=0);
+        else constants[i] = DataPtr(static_cast<int64_t>(constantSection.read<uint64_t>()));
+    }
+
+    BbvmReader debugSection = file.reader(BBVM_DEBUG);
+    uint32_t numDescriptors = debugSection.read<uint32_t>();
+    std::vector<std::shared_ptr<CommandContext>> descriptors(numDescriptors);
+    for(uint32_t i=0;i<numDescriptors;++i) descriptors[i] = std::make_shared<CommandContext>(debugSection.str());
+
+    // chunks are decompressed and decoded in parallel, and only one decompressed chunk per thread is kept at a time
+    uint32_t numInstructions;
+    std::vector<BbvmChunk> chunks = file.chunks(numInstructions);
+    int numChunks = chunks.size();
+    std::vector<std::vector<Command>> decoded(numChunks);
+    std::vector<CommandDebugTable> decodedDebug(numChunks);
+    std::vector<std::exception_ptr> errors(numChunks);
+    #pragma omp parallel for schedule(dynamic)
+    for(int c=0;c<numChunks;++c) {
+        try {
+            std::string data = file.chunk(chunks[c]);
+            BbvmReader codeSection(data.data(), data.size());
+            std::vector<Command>& chunkProgram = decoded[c];
+            chunkProgram.reserve(chunks[c].instructions);
+            std::vector<int> args;
+            for(uint32_t i=0;i<chunks[c].instructions;++i) {
+                uint16_t opcode = codeSection.read<uint16_t>();
+                // checked even for validated files, because operation numbers index dispatch tables
+                bbassertexplain(opcode<OperationTypeCount, "Corrupted bbvm file", "An instruction has an unknown operation.", "");
+                OperationType operation = static_cast<OperationType>(opcode);
+                uint16_t nargs = codeSection.read<uint16_t>();
+                uint32_t constant = codeSection.read<uint32_t>();
+                int commandLine = codeSection.read<uint32_t>();
+                uint32_t desc = codeSection.read<uint32_t>();
+                args.resize(nargs);
+                for(uint16_t arg=0;arg<nargs;++arg) {
+                    uint32_t symbol = codeSection.read<uint32_t>();
+                    bbassertexplain(symbol<numSymbols, "Corrupted bbvm file", "An instruction refers to a missing symbol.", "");
+                    args[arg] = symbols[symbol];
+                }
+                bbassertexplain(constant==BBVM_NONE || constant<numConstants, "Corrupted bbvm file", "An instruction refers to a missing constant.", "");
+                bbassertexplain(desc==BBVM_NONE || desc<numDescriptors, "Corrupted bbvm file", "An instruction refers to a missing descriptor.", "");
+                chunkProgram.emplace_back(operation, args, constant==BBVM_NONE?DataPtr::NULLP:constants[constant], source, commandLine, desc==BBVM_NONE?nullptr:descriptors[desc], decodedDebug[c]);
+            }
+        }
+        catch (...) {errors[c] = std::current_exception();}
+    }
+    for(const auto& error : errors) if(error) std::rethrow_exception(error);
+
+    program->reserve(numInstructions+1);
+    for(int c=0;c<numChunks;++c) {
+        for(auto& command : decoded[c]) program->push_back(std::move(command));
+        std::vector<Command>().swap(decoded[c]);
+        debugTable.absorb(decodedDebug[c]);
+    }
+    if(program->size()) {
+        CommandDebugInfo last = program->back().debug();
+        line = last.line;
+        descriptor = last.descriptor;
+    }
+    ++line;
+    return file.header.flags & BBVM_VALIDATED;
+}
+
+// reconstructs the textual form of a binary bbvm file
+static std::string bbvmToText(const std::string& contents) {
+    BbvmFile file(contents);
+    BbvmReader symbolSection = file.reader(BBVM_SYMBOLS);
+    std::vector<std::string> symbols(symbolSection.read<uint32_t>());
+    for(auto& symbol : symbols) {
+        symbol = symbolSection.str();
+        symbolSection.read<uint8_t>();
+    }
+
+    BbvmReader constantSection = file.reader(BBVM_CONSTANTS);
+    std::vector<std::string> constants(constantSection.read<uint32_t>());
+    for(auto& constant : constants) {
+        char type = constantSection.read<char>();
+        if(type=='"') {constant = "\""+constantSection.str()+"\""; continue;}
+        uint64_t value = constantSection.read<uint64_t>();
+        if(type=='F') {
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.17g", std::bit_cast<double>(value));
+            constant = std::string("F")+buffer;
+        }
+        else if(type=='B') constant = value?"Btrue":"Bfalse";
+        else constant = "I"+std::to_string(static_cast<int64_t>(value));
+    }
+
+    BbvmReader debugSection = file.reader(BBVM_DEBUG);
+    std::vector<std::string> descriptors(debugSection.read<uint32_t>());
+    for(auto& descriptor : descriptors) descriptor = debugSection.str();
+
+    uint32_t numInstructions;
+    std::string result;
+    uint32_t prevDescriptor = BBVM_NONE;
+    for(const BbvmChunk& chunk : file.chunks(numInstructions)) {
+        std::string data = file.chunk(chunk);
+        BbvmReader codeSection(data.data(), data.size());
+        for(uint32_t i=0;i<chunk.instructions;++i) {
+            uint16_t opcode = codeSection.read<uint16_t>();
+            bbassertexplain(opcode<OperationTypeCount, "Corrupted bbvm file", "An instruction has an unknown operation.", "");
+            OperationType operation = static_cast<OperationType>(opcode);
+            uint16_t nargs = codeSection.read<uint16_t>();
+            uint32_t constant = codeSection.read<uint32_t>();
+            codeSection.read<uint32_t>();
+            uint32_t descriptor = codeSection.read<uint32_t>();
+            if(descriptor!=prevDescriptor && descriptor!=BBVM_NONE) {
+                bbassertexplain(descriptor<descriptors.size(), "Corrupted bbvm file", "An instruction refers to a missing descriptor.", "");
+                result += "%"+descriptors[descriptor]+"\n";
+            }
+            prevDescriptor = descriptor;
+            result += getOperationTypeName(operation);
+            for(uint16_t arg=0;arg<nargs;++arg) {
+                uint32_t symbol = codeSection.read<uint32_t>();
+                bbassertexplain(symbol<symbols.size(), "Corrupted bbvm file", "An instruction refers to a missing symbol.", "");
+                result += " "+symbols[symbol];
+            }
+            if(constant!=BBVM_NONE) {
+                bbassertexplain(constant<constants.size(), "Corrupted bbvm file", "An instruction refers to a missing constant.", "");
+                result += " "+constants[constant];
+            }
+            result += "\n";
+        }
+    }
+    return result;
+}
+
+bool is_binary_bbvm_file(const std::string& source) {
+    std::ifstream input(source, std::ios::in | std::ios::binary);
+    if(!input.is_open()) return false;
+    std::string header(sizeof(BbvmHeader), '\0');
+    input.read(&header[0], header.size());
+    if(input.gcount()!=static_cast<std::streamsize>(header.size())) return false;
+    return is_binary_bbvm(header);
+}
+
+std::string read_bbvm(const std::string& source) {
+    std::string contents = readWholeFile(source);
+    if(is_binary_bbvm(contents)) return bbvmToText(contents);
+    try {return read_decompressed(source);}
+    catch (...) {return contents;}
+}
+
+// reads sources the same way that the compiler does, so that their hashes can be compared
+static std::string readSourceText(const std::string& path) {
+    if(path.size()>=5 && path.substr(path.size()-5)==".bbvm") return read_bbvm(path);
+    std::ifstream input(path);
+    if(!input.is_open()) throw std::runtime_error("Unable to read from file: " + path);
+    std::string code;
+    std::string line;
+    while (std::getline(input, line)) code += line + "\n";
+    return code;
+}
+
+// checks whether a bbvm file was compiled from the current contents of its sources with the current options,
+// in which case it grants the permissions that compiling would have granted
+bool reuse_up_to_date_bbvm(const std::string& source, const std::string& destination) {
+    try {
+        std::ifstream input(destination, std::ios::in | std::ios::binary);
+        if(!input.is_open()) return false;
+        BbvmHeader header;
+        if(!input.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+        if(std::memcmp(header.magic, BBVM_MAGIC, sizeof(BBVM_MAGIC))!=0 || header.version!=BBVM_VERSION || header.operations!=getOperationTableHash()) return false;
+        std::vector<BbvmSection> table(header.sections);
+        if(!input.read(reinterpret_cast<char*>(table.data()), table.size()*sizeof(BbvmSection))) return false;
+        for(const auto& section : table) {
+            if(section.kind!=BBVM_SOURCES) continue;
+            std::string data(section.size, '\0');
+            input.seekg(section.offset);
+            if(!input.read(&data[0], data.size())) return false;
+            if(crc32(0L, reinterpret_cast<const Bytef*>(data.data()), data.size())!=section.checksum) return false;
+            std::string contents = inflateBlock(data.data(), section.size, section.rawSize);
+            BbvmReader reader(contents.data(), contents.size());
+            if(reader.str()!=compiledSources.options) return false;
+            uint32_t numFiles = reader.read<uint32_t>();
+            for(uint32_t i=0;i<numFiles;++i) {
+                std::string path = reader.str();
+                uint64_t low = reader.read<uint64_t>();
+                uint64_t high = reader.read<uint64_t>();
+                if(i==0 && path!=normalizeFilePath(source)) return false;
+                std::string code = readSourceText(path);
+                XXH128_hash_t hash = XXH3_128bits(code.data(), code.size());
+                if(hash.low64!=low || hash.high64!=high) return false;
+            }
+            if(numFiles==0) return false;
+            std::vector<std::string> access(reader.read<uint32_t>());
+            for(auto& location : access) location = reader.str();
+            std::vector<std::string> modify(reader.read<uint32_t>());
+            for(auto& location : modify) location = reader.str();
+            for(const auto& location : access) addAllowedLocation(location);
+            for(const auto& location : modify) addAllowedWriteLocation(location);
+            return true;
+        }
+    }
+    catch (...) {}
+    return false;
+}
@@ -577,28 +577,6 @@ std::string removeCacheDuplicates(std::unordered_map<std::string, int> &programT
      return RESMOVE(result);
  }
 #include <zlib.h>
- void write_compressed(const std::string& destination, const std::string& data) {
-    // Allocate a buffer for compressed data
-    uLong sourceLen = data.size();
-    uLong destLen = compressBound(sourceLen);
-    std::vector<Bytef> compressed(destLen);
-
-    // Compress the data
-    int res = compress(compressed.data(), &destLen, reinterpret_cast<const Bytef*>(data.data()), sourceLen);
-    if (res != Z_OK) {
-        throw std::runtime_error("Compression failed");
-    }
-
-    // Write compressed data to file
-    std::ofstream outputFile(destination, std::ios::binary);
-    if (!outputFile.is_open()) {
-        throw std::runtime_error("Unable to write to file: " + destination);
-    }
-    outputFile.write(reinterpret_cast<char*>(&sourceLen), sizeof(sourceLen));
-    outputFile.write(reinterpret_cast<char*>(compressed.data()), destLen);
-    outputFile.close();
-}
-
 std::string read_decompressed(const std::string& source) {
     std::ifstream inputFile(source, std::ios::binary);
     if (!inputFile.is_open()) throw std::runtime_error("Unable to read from file: " + source);
@@ -639,7 +617,7 @@ void optimize(const std::string& source, const std::string& destination, bool mi
     optimized = cleanSymbols(optimized, uniqueSymbolCounter);
 
     if(compress) {
-        write_compressed(destination, optimized);
+        write_bbvm(destination, optimized, minimify);
         return;
     }
     std::ofstream outputFile(destination);
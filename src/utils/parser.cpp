@@ -69,12 +69,85 @@ extern bool isAllowedLocation(const std::string& path);
 extern bool isAllowedWriteLocation(const std::string& path);
 extern std::string normalizeFilePath(const std::string& path);
 extern bool isAllowedLocationNoNorm(const std::string& path_);
-extern void preliminarySimpleChecks(std::vector<Command>* program);
+extern void preliminarySimpleChecks(std::vector<Command>* program, FrameLayoutTable& frameLayouts);
 std::string top_level_file;
 std::unordered_map<std::string, std::string> comptimeCodeToCompiled;
 
 extern BMemory cachedData;
 
+// tokenized modules by path, which are reused while their contents remain the same (e.g., across !comptime)
+std::unordered_map<std::string, std::pair<CompiledSources::Entry, std::vector<Token>>> moduleTokens;
+
+const std::vector<Token>& tokenizeModule(const std::string& source, const std::string& code) {
+    CompiledSources::Entry entry = compiledSources.add(source, code);
+    auto it = moduleTokens.find(source);
+    if(it!=moduleTokens.end() && it->second.first.low==entry.low && it->second.first.high==entry.high) return it->second.second;
+    auto& cached = moduleTokens[source];
+    cached = {entry, tokenize(code, source)};
+    return cached.second;
+}
+
+// resolves the files of `!include "path"` directives the same way as macros(...), skipping ones that
+// are determined by macros or !comptime, .bbvm files, and locations that are not yet accessible
+std::vector<std::string> staticIncludes(const std::vector<Token>& tokens) {
+    std::vector<std::string> ret;
+    for(size_t i=0;i+2<tokens.size();++i) {
+        if((tokens[i].name!="#" && tokens[i].name!="!") || tokens[i+1].name!="include" || tokens[i+2].builtintype!=1) continue;
+        std::string source = tokens[i+2].name.substr(1, tokens[i+2].name.size()-2);
+        if(source.size()>=5 && source.substr(source.size()-5)==".bbvm") continue;
+        std::error_code ec;
+        source = normalizeFilePath(source);
+        if(std::filesystem::is_directory(source, ec)) source = source+"/.bb";
+        else source += ".bb";
+        if(isAllowedLocationNoNorm(source)) ret.push_back(source);
+    }
+    return ret;
+}
+
+// reads and tokenizes the include graph level by level so that independent modules are processed in
+// parallel, leaving macros(...) to splice them from moduleTokens in the same order as before; errors are
+// left for macros(...) to report where the include takes place
+void prefetchModules(const std::vector<Token>& tokens) {
+    std::unordered_set<std::string> visited;
+    std::vector<std::string> frontier = staticIncludes(tokens);
+    while(frontier.size()) {
+        std::vector<std::string> modules;
+        for(const auto& source : frontier) if(visited.insert(source).second) modules.push_back(source);
+        int numModules = modules.size();
+        std::vector<CompiledSources::Entry> entries(numModules);
+        std::vector<std::vector<Token>> tokenized(numModules);
+        std::vector<char> fresh(numModules, false);
+        std::vector<std::vector<std::string>> includes(numModules);
+        #pragma omp parallel for schedule(dynamic)
+        for(int m=0;m<numModules;++m) {
+            try {
+                std::ifstream inputFile(modules[m]);
+                if(!inputFile.is_open()) continue;
+                std::string code = "";
+                std::string line;
+                while (std::getline(inputFile, line)) code += line + "\n";
+                inputFile.close();
+                entries[m] = CompiledSources::hash(modules[m], code);
+                auto it = moduleTokens.find(modules[m]);
+                const std::vector<Token>* moduleTokensFound = nullptr;
+                if(it!=moduleTokens.end() && it->second.first.low==entries[m].low && it->second.first.high==entries[m].high) moduleTokensFound = &it->second.second;
+                else {
+                    tokenized[m] = tokenize(code, modules[m]);
+                    fresh[m] = true;
+                    moduleTokensFound = &tokenized[m];
+                }
+                includes[m] = staticIncludes(*moduleTokensFound);
+            }
+            catch (...) {}
+        }
+        frontier.clear();
+        for(int m=0;m<numModules;++m) {
+            if(fresh[m]) moduleTokens[modules[m]] = {entries[m], std::move(tokenized[m])};
+            frontier.insert(frontier.end(), includes[m].begin(), includes[m].end());
+        }
+    }
+}
+
 template <typename T> bool contains(const std::vector<T>& vec, const T& value) {
     for (auto it = vec.rbegin(); it != vec.rend(); ++it) if (*it == value) return true;
     return false;
@@ -85,6 +158,8 @@ std::string singleThreadedVMForComptime(const std::string& code, const std::stri
     std::string result;
     bool hadError = false;
     try {
+        CommandDebugTable debugTable;
+        FrameLayoutTable frameLayouts;
         std::vector<Command> program;
         {
             BMemory memory(0, nullptr, DEFAULT_LOCAL_EXPECTATION);
@@ -96,11 +171,11 @@ std::string singleThreadedVMForComptime(const std::string& code, const std::stri
                 std::shared_ptr<CommandContext> descriptor = nullptr;
                 std::istringstream inputStream(code);
                 while (std::getline(inputStream, line)) {
-                    if (line[0] != '%') program.emplace_back(line, source, i, descriptor);
+                    if (line[0] != '%') program.emplace_back(line, source, i, descriptor, debugTable);
                     else descriptor = std::make_shared<CommandContext>(line.substr(1));
                     ++i;
                 }
-                preliminarySimpleChecks(&program);
+                preliminarySimpleChecks(&program, frameLayouts);
 
                 Code code(&program, 0, program.size() - 1, program.size() - 1);
                 ExecutionInstance executor(0, &code, &memory, true);
@@ -404,17 +479,13 @@ public:
             bbassert(tokens[start+1].builtintype==1, "`!include` should always be followed by a string\n"+Parser::show_position(tokens, start+2));
             std::string fileName = tokens[start+1].name;
             fileName = fileName.substr(1, fileName.size() - 2);
-            std::unique_ptr<std::istream> inputFile;
             std::string code;
-            try {code = read_decompressed(fileName);} 
-            catch (...) {
-                std::ifstream input(fileName, std::ios::in | std::ios::binary);
-                bbassertexplain(input.is_open(), "Unable to open file: " + fileName, "Imported files with the explicit .bbvm extension are directly inserted as in the compiled code as if they have been autonomously compiled. They should be the outcome of compiling with the --library option, often accompanied by --norun.", show_position(start+2));
-                input.seekg(0, std::ios::end);
-                code.resize(static_cast<size_t>(input.tellg()));
-                input.seekg(0, std::ios::beg);
-                input.read(&code[0], static_cast<std::streamsize>(code.size()));
+            try {code = read_bbvm(fileName);} 
+            catch (const BBError&) {throw;}
+            catch (const std::runtime_error&) {
+                bberrorexplain("Unable to open file: " + fileName, "Imported files with the explicit .bbvm extension are directly inserted as in the compiled code as if they have been autonomously compiled. They should be the outcome of compiling with the --library option, often accompanied by --norun.", show_position(start+2));
             }
+            compiledSources.add(normalizeFilePath(fileName), code);
             ret += cleanSymbols(code, tmp_var);
             return "#";
         }
@@ -664,7 +735,7 @@ public:
                                 name == "bbvm::add" || name == "bbvm::sub" || 
                                 name == "bbvm::min" || name == "bbvm::max" ||  
                                 name == "bbvm::put" || 
-                                name == "bbvm::sum" || 
+                                name == "bbvm::sum" || name == "bbvm::shape" || name == "bbvm::mmul" || 
                                 name == "bbvm::call" || name == "bbvm::range" || 
                                 name == "bbvm::print" || name == "bbvm::read") {
                                 bberror("Cannot have bbvm implementation as argument `" + name + "`.\n"+show_position(next_j-1));
@@ -790,7 +861,7 @@ public:
                     first_name == "bbvm::vector" || first_name == "bbvm::iter" || 
                     first_name == "bbvm::add" || first_name == "bbvm::sub" || 
                     first_name == "bbvm::min" || first_name == "bbvm::max" ||  
-                    first_name == "bbvm::sum" || 
+                    first_name == "bbvm::sum" || first_name == "bbvm::shape" || first_name == "bbvm::mmul" || 
                     first_name == "bbvm::call" || first_name == "bbvm::range" || 
                     first_name == "bbvm::print" || first_name == "bbvm::read") {
                     bberrorexplain("Unexpected symbol.", "Cannot assign to bbvm implementation `" + first_name + "`.", show_position(start));
@@ -881,7 +952,7 @@ public:
                                 name == "bbvm::vector" || name == "bbvm::iter" || 
                                 name == "bbvm::add" || name == "bbvm::sub" || 
                                 name == "bbvm::min" || name == "bbvm::max" ||  
-                                name == "bbvm::sum" || 
+                                name == "bbvm::sum" || name == "bbvm::shape" || name == "bbvm::mmul" || 
                                 name == "bbvm::call" || name == "bbvm::range" || 
                                 name == "bbvm::print" || name == "bbvm::read") {
                                 bberrorexplain("Unexpected symbol..", "Cannot have bbvm implementation as argument `" + name + "`.", show_position(next_j-1));
@@ -1199,6 +1270,38 @@ public:
                 return "#";
             }
 
+            if (first_name == "bbvm::mmul" || first_name=="mmul") {
+                bbassertexplain(tokens[start + 1].name == "(", "Invalid syntax.", "Missing ( just after `" + first_name+"`.", show_position(start+1));
+                bbassertexplain(find_end(start + 2, end, ")") == end, "Invalid syntax.", "Leftover code after the last `)` for `" + first_name+"`.", show_position(start+2));
+                size_t separator = find_end(start + 2, end, ",");
+                bbassertexplain(separator != MISSING, "Invalid syntax.", "mmul requires two arguments.", show_position(end));
+                if(first_name.size()>=6 && first_name.substr(0, 6)=="bbvm::") first_name = first_name.substr(6);
+                std::string var = create_temp();
+                auto toret = first_name + " " + var + " " + parse_expression(start + 2, separator - 1) + " " + parse_expression(separator + 1, end - 1) + "\n";
+                breakpoint(start, end);
+                ret += toret;
+                return var;
+            }
+
+            if (first_name == "bbvm::shape" || first_name=="shape") {
+                bbassertexplain(tokens[start + 1].name == "(", "Invalid syntax.", "Missing ( just after `" + first_name+"`.", show_position(start+1));
+                bbassertexplain(find_end(start + 2, end, ")") == end, "Invalid syntax.", "Leftover code after the last `)` for `" + first_name+"`.", show_position(start+2));
+                if(first_name.size()>=6 && first_name.substr(0, 6)=="bbvm::") first_name = first_name.substr(6);
+                std::string var = create_temp();
+                std::string toret = first_name + " " + var;
+                size_t argStart = start + 2;
+                size_t separator = find_end(argStart, end, ",");
+                while(separator != MISSING) {
+                    toret += " " + parse_expression(argStart, separator - 1);
+                    argStart = separator + 1;
+                    separator = find_end(argStart, end, ",");
+                }
+                toret += " " + parse_expression(argStart, end - 1) + "\n";
+                breakpoint(start, end);
+                ret += toret;
+                return var;
+            }
+
             if (first_name == "bbvm::graphics" || first_name=="graphics") {
                 bbassertexplain(tokens[start + 1].name == "(", "Invalid syntax.", "Missing ( just after `" + first_name+"`.", show_position(start+1));
                 bbassertexplain(find_end(start + 2, end, ")") == end, "Invalid syntax.", "Leftover code after the last `)` for `" + first_name+"`.", show_position(start+2));
@@ -1261,7 +1364,7 @@ public:
                 return var;
             }
 
-            if (first_name == "bbvm::time" || first_name == "bbvm::server" || first_name == "bbvm::sqlite" || first_name == "bbvm::list") {
+            if (first_name == "bbvm::time" || first_name == "bbvm::server" || first_name == "bbvm::sqlite" || first_name == "bbvm::list" || first_name == "bbvm::stats") {
                 first_name = first_name.substr(6);
                 bbassertexplain(tokens[start + 1].name == "(", "Invalid syntax", "Missing ( after " + first_name, show_position(start));
                 if (first_name == "list") {
@@ -1335,7 +1438,7 @@ public:
                     || callable=="list::gather" || callable=="list::gather" ||
                     callable == "add" || callable == "sub" || 
                     callable == "min" || callable == "max" || 
-                    callable == "sum" || 
+                    callable == "sum" || callable == "shape" || 
                     callable == "call" || callable == "range" || 
                     callable == "print" || callable == "read" ||
                     callable == "bbvm::int" || callable == "bbvm::float" || 
@@ -1348,7 +1451,7 @@ public:
                     callable == "bbvm::vector" || callable == "bbvm::iter" || 
                     callable == "bbvm::add" || callable == "bbvm::sub" || 
                     callable == "bbvm::min" || callable == "bbvm::max" || 
-                    callable == "bbvm::sum" || 
+                    callable == "bbvm::sum" || callable == "bbvm::shape" || 
                     callable == "bbvm::call" || callable == "bbvm::range" || 
                     callable == "bbvm::print" || callable == "bbvm::read" 
                     ) {
@@ -1899,6 +2002,7 @@ void macros(std::vector<Token>& tokens, const std::string& first_source) {
             }
             else {
                 addAllowedLocation(source);
+                compiledSources.access.push_back(source);
             }
             i += 2;
             continue;
@@ -1920,6 +2024,7 @@ void macros(std::vector<Token>& tokens, const std::string& first_source) {
             }
             else {
                 addAllowedWriteLocation(source);
+                compiledSources.modify.push_back(source);
             }
             i += 2;
             continue;
@@ -2135,6 +2240,7 @@ void macros(std::vector<Token>& tokens, const std::string& first_source) {
                 comptimeCodeToCompiled[newCode] = originalCode;
             }
             else newCode = comptimeCodeToCompiled[newCode];
+            compiledSources.cacheable = false;
             newCode = singleThreadedVMForComptime(newCode, first_source);
 
             if(newCode.size()>=2 && newCode[0]=='"' && newCode[newCode.size()-1]=='"') newCode = newCode.substr(1,newCode.size()-2);
@@ -2178,6 +2284,7 @@ void macros(std::vector<Token>& tokens, const std::string& first_source) {
                 comptimeCodeToCompiled[newCode] = originalCode;
             }
             else newCode = comptimeCodeToCompiled[newCode];
+            compiledSources.cacheable = false;
             newCode = singleThreadedVMForComptime(newCode, first_source);
             
             if(newCode!="#") updatedTokens.emplace_back(newCode, tokens[starti].file, tokens[starti].line, true);
@@ -2293,7 +2400,7 @@ void macros(std::vector<Token>& tokens, const std::string& first_source) {
             while (std::getline(inputFile, line)) code += line + "\n";
             inputFile.close();
 
-            std::vector<Token> newTokens = tokenize(code, source);
+            std::vector<Token> newTokens = tokenizeModule(source, code);
             for(auto& token : newTokens) {
                 token.file.insert(token.file.begin(), tokens[i].file.begin(), tokens[i].file.end());
                 token.line.insert(token.line.begin(), tokens[i].line.begin(), tokens[i].line.end());
@@ -2474,6 +2581,7 @@ std::string compileFromCode(const std::string& code, const std::string& source_)
     if(top_level_file.empty()) top_level_file = source;
     std::vector<Token> tokens = tokenize(code, source, true);
     sanitize(tokens, !(source_.size() && source[0]!='!'));
+    prefetchModules(tokens);
     macros(tokens, source);
     Parser parser(tokens);
     parser.parse(0, tokens.size() - 1);
@@ -2490,6 +2598,8 @@ void compile(const std::string& source, const std::string& destination) {
     while (std::getline(inputFile, line)) code += line + "\n";
     inputFile.close();
 
+    compiledSources.reset();
+    compiledSources.add(normalizeFilePath(source), code);
     comptimeCodeToCompiled.clear();
     std::string compiled = compileFromCode(code, source);
     comptimeCodeToCompiled.clear();